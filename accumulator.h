@@ -0,0 +1,70 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+#include <vector>
+#include <glm/glm.hpp>
+#include "camera.h"
+#include "color.h"
+#include "light.h"
+
+// Running average of frames rendered from an unchanged view. Each frame draws
+// fresh light samples, so soft shadows converge over a few frames while the
+// camera is still. Reprojection is the identity in that case; any change of
+// camera, light or scene version starts the average over.
+class TemporalAccumulator {
+public:
+    TemporalAccumulator(int width, int height)
+            : width(width), sums(static_cast<size_t>(width) * height),
+              lastCamera(glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f), 0.0f) {}
+
+    // Call before tracing a frame. Returns how many frames are already in the
+    // average, which doubles as the sample index for the frame's noise.
+    Uint32 begin(const Camera& camera, const Light& light, Uint64 sceneVersion) {
+        if (!valid || !sameView(camera, light) || sceneVersion != lastSceneVersion) {
+            frames = 0;
+        }
+        lastCamera = camera;
+        lastLight = light;
+        lastSceneVersion = sceneVersion;
+        valid = false;
+        return frames;
+    }
+
+    // Blend this frame's radiance for a pixel into the average and return the
+    // average as a color. Radiance is on Color's 0-255 scale but not yet clamped,
+    // so samples brighter than white still count in full.
+    Color add(int x, int y, const glm::vec3& radiance) {
+        glm::vec3& sum = sums[static_cast<size_t>(y) * width + x];
+        sum = frames == 0 ? radiance : sum + radiance;
+        glm::vec3 average = sum / static_cast<float>(frames + 1);
+        return Color(static_cast<int>(average.x + 0.5f), static_cast<int>(average.y + 0.5f),
+                     static_cast<int>(average.z + 0.5f));
+    }
+
+    // Call once every pixel of the frame has been added. Frames abandoned
+    // half way are never ended, so the next one starts over.
+    void end() {
+        frames++;
+        valid = true;
+    }
+
+    Uint32 frameCount() const {
+        return frames;
+    }
+
+private:
+    int width;
+    std::vector<glm::vec3> sums;
+    Uint32 frames = 0;
+    bool valid = false;
+
+    Camera lastCamera;
+    Light lastLight{};
+    Uint64 lastSceneVersion = 0;
+
+    bool sameView(const Camera& camera, const Light& light) const {
+        return camera.position == lastCamera.position && camera.target == lastCamera.target &&
+               camera.up == lastCamera.up && light.position == lastLight.position &&
+               light.radius == lastLight.radius && light.intensity == lastLight.intensity;
+    }
+};
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+// Read-only memory mapping of a whole file, unmapped when the last owner lets go
+class MappedFile {
+public:
+    static std::shared_ptr<MappedFile> open(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return nullptr;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0) {
+            close(fd);
+            return nullptr;
+        }
+        void* mapping = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            return nullptr;
+        }
+        return std::shared_ptr<MappedFile>(new MappedFile(static_cast<const Uint8*>(mapping),
+                                                          static_cast<size_t>(info.st_size)));
+    }
+
+    ~MappedFile() {
+        munmap(const_cast<Uint8*>(bytes), length);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const Uint8* data() const {
+        return bytes;
+    }
+
+    size_t size() const {
+        return length;
+    }
+
+private:
+    const Uint8* bytes;
+    size_t length;
+
+    MappedFile(const Uint8* bytes, size_t length) : bytes(bytes), length(length) {}
+};
+
+enum AssetFormat : std::uint32_t {
+    ASSET_MIP_RGBA32 = 1, // MipTexture levels back to back, Morton ordered
+    ASSET_RGB24 = 2       // Tightly packed RGB rows
+};
+
+struct AssetCacheHeader {
+    char magic[4];
+    std::uint32_t version;
+    std::uint64_t sourceSize;
+    std::int64_t sourceMtime;
+    std::uint32_t format;
+    std::uint32_t width;
+    std::uint32_t height;
+    std::uint32_t reserved;
+};
+
+// Decoded, converted assets kept on disk so later launches can map them
+// straight into memory instead of decoding PNGs again. An entry is only used
+// while its source file still has the size and modification time it was
+// built from.
+class AssetCache {
+public:
+    static std::string directory;
+
+    // Map the cached entry for sourcePath, or return nullptr if it is missing or stale.
+    // The payload starts sizeof(AssetCacheHeader) bytes into the mapping.
+    static std::shared_ptr<MappedFile> lookup(const std::string& name, const std::string& sourcePath,
+                                              AssetFormat format, AssetCacheHeader& header) {
+        struct stat source;
+        if (stat(sourcePath.c_str(), &source) != 0) {
+            return nullptr;
+        }
+        std::shared_ptr<MappedFile> file = MappedFile::open(entryPath(name));
+        if (!file || file->size() < sizeof(AssetCacheHeader)) {
+            return nullptr;
+        }
+        std::memcpy(&header, file->data(), sizeof(header));
+        if (std::memcmp(header.magic, "ACHE", 4) != 0 || header.version != 1 || header.format != format ||
+            header.sourceSize != static_cast<std::uint64_t>(source.st_size) ||
+            header.sourceMtime != static_cast<std::int64_t>(source.st_mtime)) {
+            return nullptr;
+        }
+        return file;
+    }
+
+    // Write an entry; failures only cost the next launch a decode, so they are silent
+    static void store(const std::string& name, const std::string& sourcePath, AssetFormat format,
+                      std::uint32_t width, std::uint32_t height, const void* payload, size_t bytes) {
+        struct stat source;
+        if (stat(sourcePath.c_str(), &source) != 0) {
+            return;
+        }
+        if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+            return;
+        }
+
+        AssetCacheHeader header{{'A', 'C', 'H', 'E'}, 1, static_cast<std::uint64_t>(source.st_size),
+                                static_cast<std::int64_t>(source.st_mtime), format, width, height, 0};
+        // Write beside the entry and rename, so a reader never maps a half-written file
+        std::string path = entryPath(name);
+        std::string temporary = path + "." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+        {
+            std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(static_cast<const char*>(payload), static_cast<std::streamsize>(bytes));
+            if (!out) {
+                std::remove(temporary.c_str());
+                return;
+            }
+        }
+        std::rename(temporary.c_str(), path.c_str());
+    }
+
+private:
+    static std::string entryPath(const std::string& name) {
+        return directory + "/" + name + ".cache";
+    }
+};
+
+std::string AssetCache::directory = "../.asset_cache";
@@ -0,0 +1,422 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include <glm/glm.hpp>
+#include "object.h"
+#include "material.h"
+#include "intersect.h"
+#include "ray.h"
+
+const int CHUNK_SIZE = 16;
+const size_t CHUNK_BYTES = CHUNK_SIZE * CHUNK_SIZE * CHUNK_SIZE;
+
+// On-disk layout of a chunk world file:
+//   ChunkWorldHeader
+//   uint32 index[chunksX * chunksY * chunksZ]   slot + 1 for stored chunks, 0 for empty ones
+//   padding up to dataOffset (page aligned)
+//   CHUNK_BYTES of block ids per stored chunk, x fastest, then y, then z
+struct ChunkWorldHeader {
+    char magic[4];
+    std::uint32_t version;
+    std::uint32_t chunkSize;
+    std::int32_t chunksX;
+    std::int32_t chunksY;
+    std::int32_t chunksZ;
+    std::uint32_t storedChunks;
+    std::uint32_t reserved;
+    std::uint64_t dataOffset;
+};
+
+// A large block world stored as fixed-size chunks of one-byte material ids
+// (0 is air), memory-mapped from a file. Only the chunks rays actually visit
+// are paged in, the least recently used ones are dropped again once the
+// resident set exceeds the memory budget, and empty chunks are stepped over
+// in a single jump without touching any block data.
+//
+// Block (x, y, z) is a unit cube centred on offset + (x, y, z), matching how
+// Cube places the hand-built scene.
+class ChunkWorld : public Object {
+public:
+    ChunkWorld(const std::string& path, std::vector<Material> palette, const glm::vec3& offset,
+               size_t memoryBudget)
+            : Object(palette.empty() ? Material{} : palette.front()), palette(std::move(palette)),
+              offset(offset), memoryBudget(memoryBudget) {
+        fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Unable to open chunk world: " + path);
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(ChunkWorldHeader)) {
+            close(fd);
+            throw std::runtime_error("Chunk world file is truncated: " + path);
+        }
+        mappedSize = static_cast<size_t>(info.st_size);
+        void* mapping = mmap(nullptr, mappedSize, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapping == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("Unable to map chunk world: " + path);
+        }
+        mapped = static_cast<const std::uint8_t*>(mapping);
+
+        std::memcpy(&header, mapped, sizeof(header));
+        size_t chunkCount = static_cast<size_t>(header.chunksX) * header.chunksY * header.chunksZ;
+        size_t indexEnd = sizeof(ChunkWorldHeader) + chunkCount * sizeof(std::uint32_t);
+        if (std::memcmp(header.magic, "CWLD", 4) != 0 || header.version != 1 || header.chunkSize != CHUNK_SIZE ||
+            indexEnd > header.dataOffset || header.dataOffset + header.storedChunks * CHUNK_BYTES > mappedSize) {
+            munmap(const_cast<std::uint8_t*>(mapped), mappedSize);
+            close(fd);
+            throw std::runtime_error("Not a valid chunk world: " + path);
+        }
+
+        chunkIndex = reinterpret_cast<const std::uint32_t*>(mapped + sizeof(ChunkWorldHeader));
+        // Every slot is trusted from here on, so a corrupt index must not get past this point
+        for (size_t i = 0; i < chunkCount; i++) {
+            if (chunkIndex[i] > header.storedChunks) {
+                munmap(const_cast<std::uint8_t*>(mapped), mappedSize);
+                close(fd);
+                throw std::runtime_error("Chunk world index points past the stored chunks: " + path);
+            }
+        }
+        blockData = mapped + header.dataOffset;
+        gridSize = glm::vec3(header.chunksX, header.chunksY, header.chunksZ) * static_cast<float>(CHUNK_SIZE);
+
+        lastUsed = std::vector<std::atomic<std::uint32_t>>(header.storedChunks);
+        resident = std::vector<std::atomic<bool>>(header.storedChunks);
+    }
+
+    ~ChunkWorld() {
+        munmap(const_cast<std::uint8_t*>(mapped), mappedSize);
+        close(fd);
+    }
+
+    ChunkWorld(const ChunkWorld&) = delete;
+    ChunkWorld& operator=(const ChunkWorld&) = delete;
+
+    using Object::rayIntersect;
+
+    Intersect rayIntersect(const glm::vec3& rayOrigin, const glm::vec3& rayDirection) const {
+        return rayIntersect(Ray(rayOrigin, rayDirection));
+    }
+
+    Intersect rayIntersect(const Ray& ray) const {
+        // Work in grid space, where block (x, y, z) spans [x, x + 1)
+        glm::vec3 origin = ray.origin - offset + 0.5f;
+        const glm::vec3& dir = ray.direction;
+        const glm::vec3& invDir = ray.invDirection;
+
+        // Clip the ray to the world bounds
+        float tEnter = 0.0f;
+        float tExit = std::numeric_limits<float>::infinity();
+        int enterAxis = -1;
+        for (int i = 0; i < 3; i++) {
+            if (dir[i] == 0.0f) {
+                if (origin[i] < 0.0f || origin[i] >= gridSize[i]) {
+                    return Intersect{false};
+                }
+                continue;
+            }
+            float t0 = (0.0f - origin[i]) * invDir[i];
+            float t1 = (gridSize[i] - origin[i]) * invDir[i];
+            if (t0 > t1) {
+                std::swap(t0, t1);
+            }
+            if (t0 > tEnter) {
+                tEnter = t0;
+                enterAxis = i;
+            }
+            tExit = std::min(tExit, t1);
+        }
+        if (tEnter > tExit) {
+            return Intersect{false};
+        }
+
+        int step[3];
+        float tDelta[3];
+        for (int i = 0; i < 3; i++) {
+            step[i] = dir[i] > 0 ? 1 : -1;
+            tDelta[i] = dir[i] != 0.0f ? std::abs(invDir[i]) : std::numeric_limits<float>::infinity();
+        }
+
+        int cell[3];
+        float tMax[3];
+        float t = tEnter;
+        int axis = enterAxis;
+        glm::vec3 start = origin + dir * t;
+        for (int i = 0; i < 3; i++) {
+            cell[i] = std::clamp(static_cast<int>(std::floor(start[i])), 0, static_cast<int>(gridSize[i]) - 1);
+        }
+        if (axis >= 0) {
+            cell[axis] = step[axis] > 0 ? 0 : static_cast<int>(gridSize[axis]) - 1;
+        }
+        resetBoundaries(origin, dir, invDir, step, cell, tMax);
+
+        int chunk[3] = {-1, -1, -1};
+        const std::uint8_t* blocks = nullptr;
+
+        while (inside(cell)) {
+            int cellChunk[3] = {cell[0] / CHUNK_SIZE, cell[1] / CHUNK_SIZE, cell[2] / CHUNK_SIZE};
+            if (cellChunk[0] != chunk[0] || cellChunk[1] != chunk[1] || cellChunk[2] != chunk[2]) {
+                std::copy(cellChunk, cellChunk + 3, chunk);
+                blocks = chunkData(chunk);
+                if (!blocks) {
+                    // Empty chunk: jump straight to where the ray leaves it
+                    axis = exitAxis(origin, invDir, step, chunk, t);
+                    glm::vec3 p = origin + dir * t;
+                    for (int i = 0; i < 3; i++) {
+                        int lo = chunk[i] * CHUNK_SIZE;
+                        cell[i] = std::clamp(static_cast<int>(std::floor(p[i])), lo, lo + CHUNK_SIZE - 1);
+                    }
+                    cell[axis] = step[axis] > 0 ? (chunk[axis] + 1) * CHUNK_SIZE : chunk[axis] * CHUNK_SIZE - 1;
+                    resetBoundaries(origin, dir, invDir, step, cell, tMax);
+                    continue;
+                }
+            }
+
+            int local = ((cell[2] % CHUNK_SIZE) * CHUNK_SIZE + (cell[1] % CHUNK_SIZE)) * CHUNK_SIZE + cell[0] % CHUNK_SIZE;
+            std::uint8_t id = blocks[local];
+            if (id != 0 && id < palette.size()) {
+                if (axis < 0) {
+                    // Started inside a solid block; like Cube, report where the ray leaves it
+                    axis = nextAxis(tMax);
+                    t = tMax[axis];
+                }
+                return makeIntersect(ray, t, axis, step, cell, id);
+            }
+
+            axis = nextAxis(tMax);
+            t = tMax[axis];
+            tMax[axis] += tDelta[axis];
+            cell[axis] += step[axis];
+        }
+        return Intersect{false};
+    }
+
+    // Blocks in the world shade one another, so shadow rays must test the world
+    // even when it is the object they start from
+    bool canShadowItself() const {
+        return true;
+    }
+
+    // Start a new frame for LRU bookkeeping
+    void beginFrame() {
+        frame++;
+    }
+
+    // Page in the chunks within radius of a position, ahead of rays reaching them
+    void prefetch(const glm::vec3& position, float radius) {
+        glm::vec3 centre = position - offset + 0.5f;
+        int lo[3], hi[3];
+        int counts[3] = {header.chunksX, header.chunksY, header.chunksZ};
+        for (int i = 0; i < 3; i++) {
+            lo[i] = std::max(0, static_cast<int>(std::floor((centre[i] - radius) / CHUNK_SIZE)));
+            hi[i] = std::min(counts[i] - 1, static_cast<int>(std::floor((centre[i] + radius) / CHUNK_SIZE)));
+        }
+        for (int z = lo[2]; z <= hi[2]; z++) {
+            for (int y = lo[1]; y <= hi[1]; y++) {
+                for (int x = lo[0]; x <= hi[0]; x++) {
+                    int chunk[3] = {x, y, z};
+                    chunkData(chunk);
+                }
+            }
+        }
+    }
+
+    // Drop the least recently used chunks until the resident set fits the budget.
+    // Must not run while rays are being traced.
+    void trim() {
+        size_t budgetChunks = memoryBudget / CHUNK_BYTES;
+        if (residentCount.load() <= budgetChunks) {
+            return;
+        }
+
+        std::vector<std::uint32_t> slots;
+        for (std::uint32_t slot = 0; slot < resident.size(); slot++) {
+            if (resident[slot].load(std::memory_order_relaxed)) {
+                slots.push_back(slot);
+            }
+        }
+        size_t evictCount = slots.size() - std::min(slots.size(), budgetChunks);
+        std::nth_element(slots.begin(), slots.begin() + evictCount, slots.end(), [this](std::uint32_t a, std::uint32_t b) {
+            return lastUsed[a].load(std::memory_order_relaxed) < lastUsed[b].load(std::memory_order_relaxed);
+        });
+        for (size_t i = 0; i < evictCount; i++) {
+            madvise(const_cast<std::uint8_t*>(blockData + slots[i] * CHUNK_BYTES), CHUNK_BYTES, MADV_DONTNEED);
+            resident[slots[i]].store(false, std::memory_order_relaxed);
+        }
+        residentCount -= evictCount;
+    }
+
+    glm::vec3 sizeInBlocks() const {
+        return gridSize;
+    }
+
+    // Position of the centre of block (0, 0, 0)
+    void setOffset(const glm::vec3& newOffset) {
+        offset = newOffset;
+    }
+
+    // Write a world of the given size in chunks, asking blockAt for every block id.
+    // Chunks that come out all air are not stored at all.
+    static void write(const std::string& path, int chunksX, int chunksY, int chunksZ,
+                      const std::function<std::uint8_t(int, int, int)>& blockAt) {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            throw std::runtime_error("Unable to write chunk world: " + path);
+        }
+
+        size_t chunkCount = static_cast<size_t>(chunksX) * chunksY * chunksZ;
+        size_t indexEnd = sizeof(ChunkWorldHeader) + chunkCount * sizeof(std::uint32_t);
+        ChunkWorldHeader header{{'C', 'W', 'L', 'D'}, 1, CHUNK_SIZE, chunksX, chunksY, chunksZ, 0, 0,
+                                (indexEnd + CHUNK_BYTES - 1) / CHUNK_BYTES * CHUNK_BYTES};
+
+        std::vector<std::uint32_t> index(chunkCount, 0);
+        std::vector<std::uint8_t> blocks(CHUNK_BYTES);
+        out.seekp(static_cast<std::streamoff>(header.dataOffset));
+        for (int cz = 0; cz < chunksZ; cz++) {
+            for (int cy = 0; cy < chunksY; cy++) {
+                for (int cx = 0; cx < chunksX; cx++) {
+                    bool empty = true;
+                    size_t i = 0;
+                    for (int z = 0; z < CHUNK_SIZE; z++) {
+                        for (int y = 0; y < CHUNK_SIZE; y++) {
+                            for (int x = 0; x < CHUNK_SIZE; x++) {
+                                blocks[i] = blockAt(cx * CHUNK_SIZE + x, cy * CHUNK_SIZE + y, cz * CHUNK_SIZE + z);
+                                empty = empty && blocks[i] == 0;
+                                i++;
+                            }
+                        }
+                    }
+                    if (!empty) {
+                        index[(static_cast<size_t>(cz) * chunksY + cy) * chunksX + cx] = ++header.storedChunks;
+                        out.write(reinterpret_cast<const char*>(blocks.data()), CHUNK_BYTES);
+                    }
+                }
+            }
+        }
+
+        out.seekp(0);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(std::uint32_t));
+        if (!out) {
+            throw std::runtime_error("Unable to write chunk world: " + path);
+        }
+    }
+
+private:
+    std::vector<Material> palette;
+    glm::vec3 offset;
+    size_t memoryBudget;
+
+    int fd = -1;
+    const std::uint8_t* mapped = nullptr;
+    size_t mappedSize = 0;
+    ChunkWorldHeader header;
+    const std::uint32_t* chunkIndex = nullptr;
+    const std::uint8_t* blockData = nullptr;
+    glm::vec3 gridSize;
+
+    std::uint32_t frame = 0;
+    mutable std::vector<std::atomic<std::uint32_t>> lastUsed;
+    mutable std::vector<std::atomic<bool>> resident;
+    mutable std::atomic<size_t> residentCount{0};
+
+    bool inside(const int cell[3]) const {
+        return cell[0] >= 0 && cell[1] >= 0 && cell[2] >= 0 &&
+               cell[0] < gridSize.x && cell[1] < gridSize.y && cell[2] < gridSize.z;
+    }
+
+    // Block ids of a chunk, or nullptr if it is empty. Marks the chunk as used
+    // this frame and asks the kernel to page it in on first touch.
+    const std::uint8_t* chunkData(const int chunk[3]) const {
+        size_t linear = (static_cast<size_t>(chunk[2]) * header.chunksY + chunk[1]) * header.chunksX + chunk[0];
+        std::uint32_t slot = chunkIndex[linear];
+        if (slot == 0) {
+            return nullptr;
+        }
+        slot--;
+        const std::uint8_t* data = blockData + slot * CHUNK_BYTES;
+        lastUsed[slot].store(frame, std::memory_order_relaxed);
+        if (!resident[slot].load(std::memory_order_relaxed) && !resident[slot].exchange(true)) {
+            madvise(const_cast<std::uint8_t*>(data), CHUNK_BYTES, MADV_WILLNEED);
+            residentCount++;
+        }
+        return data;
+    }
+
+    static void resetBoundaries(const glm::vec3& origin, const glm::vec3& dir, const glm::vec3& invDir,
+                                const int step[3], const int cell[3], float tMax[3]) {
+        for (int i = 0; i < 3; i++) {
+            float boundary = static_cast<float>(cell[i] + (step[i] > 0 ? 1 : 0));
+            tMax[i] = dir[i] != 0.0f ? (boundary - origin[i]) * invDir[i] : std::numeric_limits<float>::infinity();
+        }
+    }
+
+    static int nextAxis(const float tMax[3]) {
+        if (tMax[0] < tMax[1]) {
+            return tMax[0] < tMax[2] ? 0 : 2;
+        }
+        return tMax[1] < tMax[2] ? 1 : 2;
+    }
+
+    // Axis through which the ray leaves a chunk; t is set to the exit distance
+    static int exitAxis(const glm::vec3& origin, const glm::vec3& invDir, const int step[3],
+                        const int chunk[3], float& t) {
+        float tChunk[3];
+        for (int i = 0; i < 3; i++) {
+            float boundary = static_cast<float>((chunk[i] + (step[i] > 0 ? 1 : 0)) * CHUNK_SIZE);
+            tChunk[i] = std::isinf(invDir[i]) ? std::numeric_limits<float>::infinity() : (boundary - origin[i]) * invDir[i];
+        }
+        int axis = nextAxis(tChunk);
+        t = tChunk[axis];
+        return axis;
+    }
+
+    Intersect makeIntersect(const Ray& ray, float t, int axis, const int step[3], const int cell[3],
+                            std::uint8_t id) const {
+        glm::vec3 point = ray.origin + t * ray.direction;
+        // The face we crossed always faces back towards the ray
+        glm::vec3 normal(0.0f);
+        normal[axis] = static_cast<float>(-step[axis]);
+
+        glm::vec3 minBounds = offset + glm::vec3(cell[0], cell[1], cell[2]) - 0.5f;
+        glm::vec3 hitVector = point - minBounds;
+        glm::vec2 texCoord(0.0f);
+
+        if (normal.x != 0) {
+            texCoord.x = hitVector.z;
+            texCoord.y = hitVector.y;
+        }
+        else if (normal.y != 0) {
+            texCoord.x = hitVector.x;
+            texCoord.y = hitVector.z;
+        }
+        else {
+            texCoord.x = hitVector.x;
+            texCoord.y = hitVector.y;
+        }
+
+        if (normal.x < 0 || normal.y < 0 || normal.z < 0)
+        {
+            texCoord = glm::vec2(1.0f) - texCoord;
+        }
+        texCoord = glm::clamp(texCoord, 0.0f, 1.0f);
+
+        Intersect intersect{true, t, point, normal, texCoord};
+        intersect.material = &palette[id];
+        return intersect;
+    }
+};
@@ -15,15 +15,24 @@ public:
             : center(center), sideLength(sideLength), Object(mat) {}
 
     Intersect rayIntersect(const glm::vec3& rayOrigin, const glm::vec3& rayDirection) const {
+        return rayIntersect(Ray(rayOrigin, rayDirection));
+    }
+
+    Intersect rayIntersect(const Ray& ray) const {
+        const glm::vec3& rayOrigin = ray.origin;
+        const glm::vec3& rayDirection = ray.direction;
+
         glm::vec3 halfExtents = glm::vec3(sideLength) * 0.5f;
         glm::vec3 minBounds = center - halfExtents;
         glm::vec3 maxBounds = center + halfExtents;
+        const glm::vec3 bounds[2] = {minBounds, maxBounds};
 
-        glm::vec3 tMin = (minBounds - rayOrigin) / rayDirection;
-        glm::vec3 tMax = (maxBounds - rayOrigin) / rayDirection;
-
-        glm::vec3 t1 = glm::min(tMin, tMax);
-        glm::vec3 t2 = glm::max(tMin, tMax);
+        // Slab test: the direction signs pick the near and far plane of each axis
+        glm::vec3 t1, t2;
+        for (int axis = 0; axis < 3; axis++) {
+            t1[axis] = (bounds[ray.sign[axis]][axis] - rayOrigin[axis]) * ray.invDirection[axis];
+            t2[axis] = (bounds[1 - ray.sign[axis]][axis] - rayOrigin[axis]) * ray.invDirection[axis];
+        }
 
         float tNear = glm::max(glm::max(t1.x, t1.y), t1.z);
         float tFar = glm::min(glm::min(t2.x, t2.y), t2.z);
@@ -50,7 +59,14 @@ public:
             normal = -normal;
         }
 
-        glm::vec3 hitVector = point - minBounds;
+        glm::vec2 texCoord = faceTexCoords(point - minBounds, normal, sideLength);
+
+        return Intersect{true, dist, point, glm::normalize(normal), texCoord};
+    }
+
+    // Texture coordinates of a point on a face, given its offset from the cube's
+    // minimum corner and the face normal. Shared with the visibility pre-pass.
+    static glm::vec2 faceTexCoords(const glm::vec3& hitVector, const glm::vec3& normal, float sideLength) {
         glm::vec2 texCoord(0.0f);
 
         if (normal.x != 0) {
@@ -71,8 +87,15 @@ public:
         {
             texCoord = glm::vec2(1.0f) - texCoord;
         }
+        return texCoord;
+    }
 
-        return Intersect{true, dist, point, glm::normalize(normal), texCoord};
+    const glm::vec3& getCenter() const {
+        return center;
+    }
+
+    float getSideLength() const {
+        return sideLength;
     }
 
 private:
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+#include <vector>
+#include "color.h"
+
+// Color is laid out as r, g, b, a bytes, which is exactly SDL_PIXELFORMAT_RGBA32,
+// so a framebuffer can be uploaded to a streaming texture without conversion.
+static_assert(sizeof(Color) == 4, "Color must stay a packed RGBA32 pixel");
+
+struct Framebuffer {
+    int width = 0;
+    int height = 0;
+    Uint64 frameNumber = 0;
+    // Frames averaged into this one by temporal accumulation, 0 when it is off
+    Uint32 accumulatedFrames = 0;
+    std::vector<Color> pixels;
+
+    Framebuffer() = default;
+
+    Framebuffer(int width, int height)
+            : width(width), height(height), pixels(static_cast<size_t>(width) * height) {}
+
+    void setPixel(int x, int y, const Color& color) {
+        pixels[static_cast<size_t>(y) * width + x] = color;
+    }
+
+    const Color& getPixel(int x, int y) const {
+        return pixels[static_cast<size_t>(y) * width + x];
+    }
+
+    int pitch() const {
+        return width * static_cast<int>(sizeof(Color));
+    }
+};
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Finished frames published into a shared memory ring, so other processes
+// (viewers, recorders, diff tools) can read them in place without sockets or
+// copies. The mapping starts with a FrameExportHeader; slot i begins
+// FRAME_EXPORT_ALIGN + i * slotStride bytes in, with a FrameSlotHeader followed
+// by the pixels at FRAME_SLOT_PIXELS.
+//
+// Each slot is a seqlock: the writer makes its sequence odd, writes, then makes
+// it even again. A reader samples the sequence, reads, and keeps the result
+// only if the sequence is unchanged and even. The writer never waits on readers.
+
+const std::uint32_t FRAME_EXPORT_VERSION = 1;
+const std::uint32_t FRAME_FORMAT_RGBA32 = 1;
+const size_t FRAME_EXPORT_ALIGN = 4096;
+const size_t FRAME_SLOT_PIXELS = 64;
+
+// The counters are shared across processes, which only works when they are plain words
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "Frame export needs lock-free 64-bit atomics");
+
+struct FrameExportHeader {
+    char magic[4]; // "FRMX", written last so readers never see a half-built header
+    std::uint32_t version;
+    std::uint32_t width;
+    std::uint32_t height;
+    std::uint32_t pitch;
+    std::uint32_t format;
+    std::uint32_t slotCount;
+    std::uint32_t reserved;
+    std::uint64_t slotStride;
+    // Frame number of the newest complete frame, 0 until the first one
+    std::atomic<std::uint64_t> latestFrame;
+};
+
+struct FrameSlotHeader {
+    std::atomic<std::uint64_t> sequence; // Odd while the slot is being written
+    std::uint64_t frameNumber;
+    std::uint64_t timestampNs;           // steady_clock when the frame was published
+    std::uint32_t accumulatedFrames;
+    std::uint32_t reserved;
+};
+
+static_assert(sizeof(FrameSlotHeader) <= FRAME_SLOT_PIXELS, "Slot header overlaps the pixels");
+
+// A name like "/raytracer" is a POSIX shared memory object, anything else a file path
+inline bool isSharedMemoryName(const std::string& name) {
+    return name.size() > 1 && name[0] == '/' && name.find('/', 1) == std::string::npos;
+}
+
+inline std::uint64_t frameTimestampNs() {
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Writing side, owned by the renderer
+class FrameExporter {
+public:
+    FrameExporter(const std::string& name, int width, int height, int slotCount)
+            : name(name), sharedMemory(isSharedMemoryName(name)), slotCount(slotCount) {
+        size_t pitch = static_cast<size_t>(width) * 4;
+        slotStride = roundUp(FRAME_SLOT_PIXELS + pitch * height);
+        length = FRAME_EXPORT_ALIGN + slotStride * slotCount;
+
+        int fd = sharedMemory ? shm_open(name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644)
+                              : ::open(name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to create frame export " + name + ": " + std::strerror(errno));
+        }
+        if (ftruncate(fd, static_cast<off_t>(length)) != 0) {
+            int error = errno;
+            close(fd);
+            throw std::runtime_error("Failed to size frame export " + name + ": " + std::strerror(error));
+        }
+        void* mapping = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            throw std::runtime_error("Failed to map frame export " + name + ": " + std::strerror(errno));
+        }
+        base = static_cast<std::uint8_t*>(mapping);
+
+        // The fresh mapping is zeroed, so every slot starts out even and empty
+        FrameExportHeader* header = this->header();
+        header->version = FRAME_EXPORT_VERSION;
+        header->width = static_cast<std::uint32_t>(width);
+        header->height = static_cast<std::uint32_t>(height);
+        header->pitch = static_cast<std::uint32_t>(pitch);
+        header->format = FRAME_FORMAT_RGBA32;
+        header->slotCount = static_cast<std::uint32_t>(slotCount);
+        header->slotStride = slotStride;
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(header->magic, "FRMX", 4);
+    }
+
+    ~FrameExporter() {
+        munmap(base, length);
+        // Readers keep their mappings; this only stops new ones finding a dead ring
+        if (sharedMemory) {
+            shm_unlink(name.c_str());
+        }
+    }
+
+    FrameExporter(const FrameExporter&) = delete;
+    FrameExporter& operator=(const FrameExporter&) = delete;
+
+    // Copy a finished RGBA32 frame into its slot. Frames go round the ring by
+    // number, so a reader working on the newest one has slotCount - 1 frames of
+    // time before it is overwritten.
+    void publish(std::uint64_t frameNumber, std::uint32_t accumulatedFrames, const void* pixels) {
+        FrameExportHeader* header = this->header();
+        std::uint8_t* slot = base + FRAME_EXPORT_ALIGN + slotStride * (frameNumber % slotCount);
+        FrameSlotHeader* slotHeader = reinterpret_cast<FrameSlotHeader*>(slot);
+
+        std::uint64_t sequence = slotHeader->sequence.load(std::memory_order_relaxed);
+        slotHeader->sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        slotHeader->frameNumber = frameNumber;
+        slotHeader->timestampNs = frameTimestampNs();
+        slotHeader->accumulatedFrames = accumulatedFrames;
+        std::memcpy(slot + FRAME_SLOT_PIXELS, pixels, static_cast<size_t>(header->pitch) * header->height);
+
+        slotHeader->sequence.store(sequence + 2, std::memory_order_release);
+        header->latestFrame.store(frameNumber, std::memory_order_release);
+    }
+
+private:
+    std::string name;
+    bool sharedMemory;
+    int slotCount;
+    size_t slotStride = 0;
+    size_t length = 0;
+    std::uint8_t* base = nullptr;
+
+    FrameExportHeader* header() const {
+        return reinterpret_cast<FrameExportHeader*>(base);
+    }
+
+    static size_t roundUp(size_t bytes) {
+        return (bytes + FRAME_EXPORT_ALIGN - 1) / FRAME_EXPORT_ALIGN * FRAME_EXPORT_ALIGN;
+    }
+};
+
+// Reading side, for consumers in other processes
+class FrameReader {
+public:
+    // Throws if the ring does not exist yet or is not one this reader understands
+    explicit FrameReader(const std::string& name) {
+        int fd = isSharedMemoryName(name) ? shm_open(name.c_str(), O_RDONLY, 0)
+                                          : ::open(name.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to open frame export " + name + ": " + std::strerror(errno));
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < FRAME_EXPORT_ALIGN) {
+            close(fd);
+            throw std::runtime_error("Frame export " + name + " is not initialised");
+        }
+        length = static_cast<size_t>(info.st_size);
+        void* mapping = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            throw std::runtime_error("Failed to map frame export " + name + ": " + std::strerror(errno));
+        }
+        base = static_cast<const std::uint8_t*>(mapping);
+
+        const FrameExportHeader& header = this->header();
+        if (std::memcmp(header.magic, "FRMX", 4) != 0 || header.version != FRAME_EXPORT_VERSION ||
+            header.format != FRAME_FORMAT_RGBA32 || header.slotCount == 0 ||
+            FRAME_EXPORT_ALIGN + header.slotStride * header.slotCount > length) {
+            munmap(const_cast<std::uint8_t*>(base), length);
+            throw std::runtime_error("Frame export " + name + " has an unsupported layout");
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+    }
+
+    ~FrameReader() {
+        munmap(const_cast<std::uint8_t*>(base), length);
+    }
+
+    FrameReader(const FrameReader&) = delete;
+    FrameReader& operator=(const FrameReader&) = delete;
+
+    const FrameExportHeader& header() const {
+        return *reinterpret_cast<const FrameExportHeader*>(base);
+    }
+
+    std::uint64_t latestFrame() const {
+        return header().latestFrame.load(std::memory_order_acquire);
+    }
+
+    // Run fn(slot, pixels) on the newest frame straight from shared memory.
+    // Returns false if there is no frame yet or the writer reused the slot
+    // while fn ran; whatever fn computed must then be thrown away.
+    template <typename F>
+    bool readLatest(F&& fn) const {
+        std::uint64_t frameNumber = latestFrame();
+        if (frameNumber == 0) {
+            return false;
+        }
+        const std::uint8_t* slot = base + FRAME_EXPORT_ALIGN + header().slotStride * (frameNumber % header().slotCount);
+        const FrameSlotHeader& slotHeader = *reinterpret_cast<const FrameSlotHeader*>(slot);
+
+        std::uint64_t before = slotHeader.sequence.load(std::memory_order_acquire);
+        if (before & 1) {
+            return false;
+        }
+        fn(slotHeader, slot + FRAME_SLOT_PIXELS);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slotHeader.sequence.load(std::memory_order_relaxed) == before &&
+               slotHeader.frameNumber == frameNumber;
+    }
+
+private:
+    const std::uint8_t* base = nullptr;
+    size_t length = 0;
+};
@@ -0,0 +1,108 @@
+// Reference consumer for the frame export ring (see frameexport.h).
+//
+//   framereader <name> [--frames n] [--ppm prefix]
+//
+// Follows the newest frame, prints its number, size, latency and mean color,
+// and with --ppm also writes each frame it saw as prefix-<frame>.ppm.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "frameexport.h"
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "usage: framereader <name> [--frames n] [--ppm prefix]" << std::endl;
+        return 1;
+    }
+    std::string name = argv[1];
+    long framesWanted = -1;
+    std::string ppmPrefix;
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--frames" && i + 1 < argc) {
+            framesWanted = std::stol(argv[++i]);
+        } else if (arg == "--ppm" && i + 1 < argc) {
+            ppmPrefix = argv[++i];
+        }
+    }
+
+    try {
+        FrameReader reader(name);
+        const FrameExportHeader& header = reader.header();
+        std::cout << "Reading " << header.width << "x" << header.height << " frames from " << name
+                  << " (" << header.slotCount << " slots)" << std::endl;
+
+        std::uint64_t lastFrame = 0;
+        long framesRead = 0;
+        long tornReads = 0;
+        std::vector<std::uint8_t> rgb;
+
+        while (framesWanted < 0 || framesRead < framesWanted) {
+            if (reader.latestFrame() == lastFrame) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+
+            // Work on the pixels where they lie; the results only count if the
+            // writer left the slot alone meanwhile
+            std::uint64_t frameNumber = 0;
+            std::uint64_t latencyNs = 0;
+            std::uint32_t accumulated = 0;
+            std::uint64_t sum[3] = {0, 0, 0};
+            bool read = reader.readLatest([&](const FrameSlotHeader& slot, const std::uint8_t* pixels) {
+                frameNumber = slot.frameNumber;
+                latencyNs = frameTimestampNs() - slot.timestampNs;
+                accumulated = slot.accumulatedFrames;
+                sum[0] = sum[1] = sum[2] = 0;
+                if (!ppmPrefix.empty()) {
+                    rgb.resize(static_cast<size_t>(header.width) * header.height * 3);
+                }
+                for (std::uint32_t y = 0; y < header.height; y++) {
+                    const std::uint8_t* row = pixels + static_cast<size_t>(y) * header.pitch;
+                    for (std::uint32_t x = 0; x < header.width; x++) {
+                        const std::uint8_t* p = row + x * 4;
+                        sum[0] += p[0];
+                        sum[1] += p[1];
+                        sum[2] += p[2];
+                        if (!ppmPrefix.empty()) {
+                            std::uint8_t* out = &rgb[(static_cast<size_t>(y) * header.width + x) * 3];
+                            out[0] = p[0];
+                            out[1] = p[1];
+                            out[2] = p[2];
+                        }
+                    }
+                }
+            });
+            if (!read) {
+                tornReads++;
+                continue;
+            }
+            lastFrame = frameNumber;
+            framesRead++;
+
+            double pixelCount = static_cast<double>(header.width) * header.height;
+            std::printf("frame %llu  accumulated %u  latency %.2f ms  mean (%.1f, %.1f, %.1f)\n",
+                        static_cast<unsigned long long>(frameNumber), accumulated, latencyNs / 1e6,
+                        sum[0] / pixelCount, sum[1] / pixelCount, sum[2] / pixelCount);
+            std::fflush(stdout);
+
+            if (!ppmPrefix.empty()) {
+                std::ofstream out(ppmPrefix + "-" + std::to_string(frameNumber) + ".ppm", std::ios::binary);
+                out << "P6\n" << header.width << " " << header.height << "\n255\n";
+                out.write(reinterpret_cast<const char*>(rgb.data()), static_cast<std::streamsize>(rgb.size()));
+            }
+        }
+        std::cout << framesRead << " frames read, " << tornReads << " reads retried" << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
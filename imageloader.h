@@ -3,14 +3,53 @@
 #include <SDL2/SDL_image.h>
 #include <SDL2/SDL_render.h>
 #include <stdexcept>
+#include <future>
 #include <map>
+#include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "color.h"
+#include "texture.h"
+#include "assetcache.h"
+#include "threadpool.h"
 
 class ImageLoader {
 private:
-    static std::map<std::string, SDL_Surface*> imageSurfaces;
+    static std::map<std::string, MipTexture> textures;
+
+    // Map the texture from the asset cache, or decode the PNG, convert it once to
+    // RGBA, build its mip chain and cache that for the next launch
+    static MipTexture decodeImage(const std::string& key, const std::string& path) {
+        AssetCacheHeader header;
+        std::shared_ptr<MappedFile> cached = AssetCache::lookup("texture-" + key, path, ASSET_MIP_RGBA32, header);
+        // The mapped size and layout are trusted from here on, so anything but a
+        // square power-of-two chain that fits in the file is decoded again instead
+        std::uint32_t size = header.width;
+        bool validSize = cached && size > 0 && size <= 65536 && (size & (size - 1)) == 0 && header.height == size;
+        if (validSize && cached->size() >= sizeof(header) + MipTexture::texelCount(static_cast<int>(size)) * sizeof(Color)) {
+            const Color* texels = reinterpret_cast<const Color*>(cached->data() + sizeof(header));
+            return MipTexture(static_cast<int>(header.width), texels, cached);
+        }
+
+        SDL_Surface* newSurface = IMG_Load(path.c_str());
+        if (!newSurface) {
+            throw std::runtime_error("Unable to load image! SDL_image Error: " + std::string(IMG_GetError()));
+        }
+        SDL_Surface* rgbaSurface = SDL_ConvertSurfaceFormat(newSurface, SDL_PIXELFORMAT_RGBA32, 0);
+        SDL_FreeSurface(newSurface);
+        if (!rgbaSurface) {
+            throw std::runtime_error("Unable to convert image to RGBA! SDL Error: " + std::string(SDL_GetError()));
+        }
+        MipTexture texture(rgbaSurface->w, rgbaSurface->h, rgbaSurface->pitch,
+                           static_cast<const Uint8*>(rgbaSurface->pixels));
+        SDL_FreeSurface(rgbaSurface);
+
+        AssetCache::store("texture-" + key, path, ASSET_MIP_RGBA32, texture.size(), texture.size(), texture.data(),
+                          MipTexture::texelCount(texture.size()) * sizeof(Color));
+        return texture;
+    }
 public:
     // Initialize SDL_image
     static void init() {
@@ -22,51 +61,41 @@ public:
 
     // Load an image from a given path and store with a key
     static void loadImage(const std::string& key, const char* path) {
-        SDL_Surface* newSurface = IMG_Load(path);
-        if (!newSurface) {
-            throw std::runtime_error("Unable to load image! SDL_image Error: " + std::string(IMG_GetError()));
+        textures[key] = decodeImage(key, path);
+    }
+
+    // Load several images at once, decoding them in parallel on the pool.
+    // Returns once every texture is available.
+    static void loadImages(const std::vector<std::pair<std::string, std::string>>& images, ThreadPool& pool) {
+        std::vector<std::future<MipTexture>> decoded;
+        for (const auto& [key, path] : images) {
+            decoded.push_back(pool.submit([key = key, path = path] {
+                return decodeImage(key, path);
+            }));
+        }
+        for (size_t i = 0; i < images.size(); i++) {
+            textures[images[i].first] = decoded[i].get();
         }
-        imageSurfaces[key] = newSurface;
     }
 
-    // Get the color of the pixel at (x, y) from an image with a specific key
-    static Color getPixelColor(const std::string& key, int x, int y) {
-        auto it = imageSurfaces.find(key);
-        if (it == imageSurfaces.end()) {
+    static const MipTexture& getTexture(const std::string& key) {
+        auto it = textures.find(key);
+        if (it == textures.end()) {
             throw std::runtime_error("Image key not found!");
         }
+        return it->second;
+    }
 
-        SDL_Surface* targetSurface = it->second;
-        int bpp = targetSurface->format->BytesPerPixel;
-        Uint8 *p = (Uint8 *)targetSurface->pixels + y * targetSurface->pitch + x * bpp;
+    // Get the color of the pixel at (x, y) from the full-resolution image with a specific key
+    static Color getPixelColor(const std::string& key, int x, int y) {
+        return getTexture(key).fetch(0, x, y);
+    }
 
-        Uint32 pixelColor;
-        switch (bpp) {
-            case 1:
-                pixelColor = *p;
-                break;
-            case 2:
-                pixelColor = *(Uint16 *)p;
-                break;
-            case 3:
-                if (SDL_BYTEORDER == SDL_BIG_ENDIAN) {
-                    pixelColor = p[0] << 16 | p[1] << 8 | p[2];
-                } else {
-                    pixelColor = p[0] | p[1] << 8 | p[2] << 16;
-                }
-                break;
-            case 4:
-                pixelColor = *(Uint32 *)p;
-                break;
-            default:
-                throw std::runtime_error("Unknown format!");
-        }
-        
-        SDL_Color color;
-        SDL_GetRGBA(pixelColor, targetSurface->format, &color.r, &color.g, &color.b, &color.a);
-        return Color{color.r, color.g, color.b, color.a};
+    // Sample the image at level-0 texel coordinates (x, y), reading from the mip
+    // level that matches lod (log2 of the texels covered by one pixel)
+    static Color sampleColor(const std::string& key, float x, float y, float lod) {
+        return getTexture(key).sample(x, y, lod);
     }
 };
 
-std::map<std::string, SDL_Surface*> ImageLoader::imageSurfaces;
-
+std::map<std::string, MipTexture> ImageLoader::textures;
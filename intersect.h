@@ -2,11 +2,14 @@
 
 #include <glm/glm.hpp>
 
+struct Material;
+
 struct Intersect {
   bool isIntersecting = false;
   float dist = 0.0f;
   glm::vec3 point;
   glm::vec3 normal;
   glm::vec2 textureCoords;
+  const Material* material = nullptr; // Set by objects made of several materials
 };
 
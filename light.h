@@ -7,4 +7,5 @@ struct Light {
   glm::vec3 position;
   float intensity;
   Color color;
+  float radius = 0.0f; // Spherical area light; 0 is a point light
 };
@@ -1,7 +1,20 @@
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_events.h>
 #include <SDL2/SDL_render.h>
+#include <cmath>
 #include <cstdlib>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+#include <malloc.h>
+#define HAVE_MALLINFO2 1
+#endif
+#include <map>
+#include <memory>
+#include <random>
 #include <glm/ext/quaternion_geometric.hpp>
 #include <glm/geometric.hpp>
 #include <string>
@@ -15,46 +28,190 @@
 #include "cube.h"
 #include "imageloader.h"
 #include "skybox.h"
+#include "framebuffer.h"
+#include "threadpool.h"
+#include "renderthread.h"
+#include "ray.h"
+#include "raygen.h"
+#include "chunkworld.h"
+#include "visibility.h"
+#include "scenes.h"
+#include "accumulator.h"
+#include "frameexport.h"
 
 const int SCREEN_WIDTH = 800;
 const int SCREEN_HEIGHT = 600;
-const float ASPECT_RATIO = static_cast<float>(SCREEN_WIDTH) / static_cast<float>(SCREEN_HEIGHT);
+const float FOV = 3.1415f / 3;
 const int MAX_RECURSION = 3;
 const float BIAS = 0.0001f;
-Skybox skybox("../BG/skybox.png");
+// Shadow rays leaving a self-shadowing object start this far towards the light
+const float SELF_SHADOW_BIAS = 0.001f;
+// Chunks within this distance of the camera are paged in before rays reach them
+const float WORLD_PREFETCH_RADIUS = 32.0f;
+// Shadow rays per area light per pixel each frame
+const int SHADOW_SAMPLES = 2;
+// Frames averaged while the view is still before rendering stops
+const Uint32 TEMPORAL_FRAMES = 32;
+// Slots in the frame export ring; readers get this many frames minus one to finish with one
+const int DEFAULT_EXPORT_SLOTS = 3;
+// Frames rendered per benchmark camera; the fastest one counts
+const int BENCHMARK_FRAMES = 3;
+// Scene memory may grow by this much on top of the tolerance, so tiny scenes don't flap
+const double BENCHMARK_MEMORY_SLACK_MB = 0.004;
+// Angle subtended by one pixel, used to estimate texture footprints
+const float PIXEL_SPREAD = 2.0f * std::tan(FOV / 2.0f) / SCREEN_HEIGHT;
+// Loaded in the background once the pool exists; see main()
+Skybox skybox;
+
+// Rays and shading terms weighing less than this on the final pixel are skipped
+float minThroughput = 0.02f;
+// Offline mode: weak rays play Russian roulette instead of being cut off, which keeps the image unbiased
+bool russianRoulette = false;
 
 SDL_Renderer* renderer;
+ThreadPool* renderPool;
 std::vector<Object*> objects;
+ChunkWorld* world = nullptr;
+
+// Optional rasterised pre-pass for primary visibility. Cubes are rasterised,
+// any other object is still traced per pixel and depth-tested against them.
+bool useVisibilityPrepass = false;
+// Also trace every primary ray and log how many pixels disagree with the pre-pass
+bool validateVisibility = false;
+// Only allocated once the pre-pass is enabled; see prepareVisibility()
+VisibilityBuffer* visibility = nullptr;
+std::vector<const Cube*> rasterCubes;
+std::vector<int> rasterIds;
+std::vector<Object*> tracedObjects;
+
+// Materials by block id for chunk worlds; id 0 is air
+enum BlockId : std::uint8_t { AIR, CHERRY_PLANKS, OAK_LOG, CHERRY_LEAVES, ACACIA_LEAVES, BASALT, REDSTONE_LAMP, GLASS };
+std::vector<Material> blockPalette;
+
+// Averages frames while the view is still; only touched by the render thread
+TemporalAccumulator accumulator(SCREEN_WIDTH, SCREEN_HEIGHT);
 Light light{glm::vec3(-1.0, 0.0, 0.0), 1.5f, Color(255, 255, 255)};
 Camera camera(glm::vec3(0.0, 0.0, 5.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), 10.0f);
 
 
-void point(glm::vec2 position, Color color) {
-    SDL_SetRenderDrawColor(renderer, color.r, color.g, color.b, color.a);
-    SDL_RenderDrawPoint(renderer, position.x, position.y);
+void point(Framebuffer& framebuffer, glm::vec2 position, Color color) {
+    framebuffer.setPixel(position.x, position.y, color);
 }
 
-float castShadow(const glm::vec3& shadowOrigin, const glm::vec3& lightDir, Object* hitObject) {
+// Rays carry radiance as floats on the 0-255 scale of Color, so values boosted
+// past 255 by Russian roulette survive until the pixel is written
+glm::vec3 toRadiance(const Color& color) {
+    return glm::vec3(color.r, color.g, color.b);
+}
+
+Color toColor(const glm::vec3& radiance) {
+    return Color(static_cast<int>(radiance.x + 0.5f), static_cast<int>(radiance.y + 0.5f),
+                 static_cast<int>(radiance.z + 0.5f));
+}
+
+// Decide whether a secondary ray carrying the given weight is worth tracing.
+// Under Russian roulette a weak ray survives with probability weight / minThroughput
+// and compensation is set to 1 / probability so the expected value is unchanged.
+bool shouldTrace(float weight, float& compensation) {
+    compensation = 1.0f;
+    if (weight >= minThroughput) {
+        return true;
+    }
+    if (!russianRoulette || weight <= 0.0f) {
+        return false;
+    }
+
+    thread_local std::minstd_rand rng(std::random_device{}());
+    float survival = weight / minThroughput;
+    if (std::uniform_real_distribution<float>(0.0f, 1.0f)(rng) >= survival) {
+        return false;
+    }
+    compensation = 1.0f / survival;
+    return true;
+}
+
+float fract(float x) {
+    return x - std::floor(x);
+}
+
+// Interleaved gradient noise: a cheap per-pixel pattern with a blue-noise-like
+// spectrum, shifted every frame so accumulated frames use different samples
+glm::vec2 pixelBlueNoise(int x, int y, Uint32 frame) {
+    float fx = x + 5.588238f * static_cast<float>(frame & 63);
+    float fy = y + 5.588238f * static_cast<float>(frame & 63);
+    auto noise = [](float a, float b) {
+        return fract(52.9829189f * fract(0.06711056f * a + 0.00583715f * b));
+    };
+    return glm::vec2(noise(fx, fy), noise(fy + 47.0f, fx + 13.0f));
+}
+
+// Distance to the first object found between shadowOrigin and maxDist along
+// shadowDir, or infinity if nothing is in the way
+float findOccluder(const glm::vec3& shadowOrigin, const glm::vec3& shadowDir, float maxDist, Object* hitObject) {
+    Ray shadowRay(shadowOrigin, shadowDir);
+    Ray selfShadowRay(shadowOrigin + shadowDir * SELF_SHADOW_BIAS, shadowDir, shadowRay.invDirection);
     for (auto& obj : objects) {
-        if (obj != hitObject) {
-            Intersect shadowIntersect = obj->rayIntersect(shadowOrigin, lightDir);
-            if (shadowIntersect.isIntersecting && shadowIntersect.dist > 0) {
-                float shadowRatio = shadowIntersect.dist / glm::length(light.position - shadowOrigin);
-                shadowRatio = glm::min(1.0f, shadowRatio);
-                return 1.0f - shadowRatio;
+        if (obj != hitObject || obj->canShadowItself()) {
+            Intersect shadowIntersect = obj->rayIntersect(obj == hitObject ? selfShadowRay : shadowRay);
+            if (shadowIntersect.isIntersecting && shadowIntersect.dist > 0 && shadowIntersect.dist < maxDist) {
+                return shadowIntersect.dist;
             }
         }
     }
-    return 1.0f;
+    return std::numeric_limits<float>::infinity();
+}
+
+// noise is the shaded pixel's blue noise, which places the area light samples
+float castShadow(const glm::vec3& shadowOrigin, const glm::vec3& lightDir, Object* hitObject, const Light& light,
+                 const glm::vec2& noise) {
+    if (light.radius > 0.0f) {
+        // Area light: a few rays towards points on the disk the light presents to
+        // this point, placed by the pixel's blue noise plus an R2 sequence offset
+        glm::vec3 toLight = light.position - shadowOrigin;
+        glm::vec3 axis = glm::normalize(toLight);
+        glm::vec3 helper = std::abs(axis.y) < 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+        glm::vec3 tangent = glm::normalize(glm::cross(axis, helper));
+        glm::vec3 bitangent = glm::cross(axis, tangent);
+
+        int lit = 0;
+        for (int s = 0; s < SHADOW_SAMPLES; s++) {
+            float u = fract(noise.x + s * 0.7548776662f);
+            float v = fract(noise.y + s * 0.5698402910f);
+            float r = light.radius * std::sqrt(u);
+            float phi = 2.0f * static_cast<float>(M_PI) * v;
+            glm::vec3 target = light.position + (tangent * std::cos(phi) + bitangent * std::sin(phi)) * r;
+
+            glm::vec3 shadowDir = target - shadowOrigin;
+            float dist = glm::length(shadowDir);
+            lit += std::isinf(findOccluder(shadowOrigin, shadowDir / dist, dist, hitObject));
+        }
+        return static_cast<float>(lit) / SHADOW_SAMPLES;
+    }
+
+    float occluderDist = findOccluder(shadowOrigin, lightDir, std::numeric_limits<float>::infinity(), hitObject);
+    if (std::isinf(occluderDist)) {
+        return 1.0f;
+    }
+    float shadowRatio = occluderDist / glm::length(light.position - shadowOrigin);
+    shadowRatio = glm::min(1.0f, shadowRatio);
+    return 1.0f - shadowRatio;
 }
 
-Color castRay(const glm::vec3& rayOrigin, const glm::vec3& rayDirection, const short recursion = 0) {
+glm::vec3 shade(const Ray& ray, const Intersect& intersect, Object* hitObject, const Light& light,
+                const glm::vec2& noise, short recursion, float pathDistance, float throughput);
+
+// pathDistance is how far the ray has already travelled from the camera, so
+// texture lookups can pick a mip level for the total footprint. throughput is
+// the weight this ray's color will have on the final pixel, and noise the blue
+// noise of the pixel it belongs to.
+glm::vec3 castRay(const Ray& ray, const Light& light, const glm::vec2& noise, const short recursion = 0,
+                  const float pathDistance = 0.0f, const float throughput = 1.0f) {
     float zBuffer = 99999;
     Object* hitObject = nullptr;
     Intersect intersect;
 
     for (const auto& object : objects) {
-        Intersect i = object->rayIntersect(rayOrigin, rayDirection);
+        Intersect i = object->rayIntersect(ray);
         if (i.isIntersecting && i.dist < zBuffer) {
             zBuffer = i.dist;
             hitObject = object;
@@ -62,46 +219,81 @@ Color castRay(const glm::vec3& rayOrigin, const glm::vec3& rayDirection, const s
         }
     }
 
-    if (!intersect.isIntersecting || recursion == MAX_RECURSION) {
-        return skybox.getColor(rayDirection);
+    if (!intersect.isIntersecting) {
+        return toRadiance(skybox.getColor(ray.direction));
     }
+    return shade(ray, intersect, hitObject, light, noise, recursion, pathDistance, throughput);
+}
 
+// Light a hit found either by castRay or by the visibility pre-pass
+glm::vec3 shade(const Ray& ray, const Intersect& intersect, Object* hitObject, const Light& light,
+                const glm::vec2& noise, short recursion, float pathDistance, float throughput) {
+    const glm::vec3& rayOrigin = ray.origin;
+    const glm::vec3& rayDirection = ray.direction;
 
     glm::vec3 lightDir = glm::normalize(light.position - intersect.point);
     glm::vec3 viewDir = glm::normalize(rayOrigin - intersect.point);
     glm::vec3 reflectDir = glm::reflect(-lightDir, intersect.normal);
 
-    float shadowIntensity = castShadow(intersect.point, lightDir, hitObject);
-
-    float diffuseLightIntensity = std::max(0.0f, glm::dot(intersect.normal, lightDir));
-    float specReflection = glm::dot(viewDir, reflectDir);
-    
-    Material mat = hitObject->material;
+    Material mat = intersect.material ? *intersect.material : hitObject->material;
 
-    float specLightIntensity = std::pow(std::max(0.0f, glm::dot(viewDir, reflectDir)), mat.specularCoefficient);
+    // Rays past the material's depth limit, or cut off for carrying too little
+    // weight, see the sky as they would have at MAX_RECURSION
+    int depthLimit = mat.maxRecursion > 0 ? mat.maxRecursion : MAX_RECURSION;
+    bool canRecurse = recursion + 1 < depthLimit;
+    float compensation;
 
-
-    Color reflectedColor(0.0f, 0.0f, 0.0f);
+    glm::vec3 reflectedColor(0.0f);
     if (mat.reflectivity > 0) {
-        glm::vec3 origin = intersect.point + intersect.normal * BIAS;
-        reflectedColor = castRay(origin, reflectDir, recursion + 1); 
+        float weight = throughput * mat.reflectivity;
+        if (!canRecurse) {
+            reflectedColor = toRadiance(skybox.getColor(reflectDir));
+        } else if (shouldTrace(weight, compensation)) {
+            glm::vec3 origin = intersect.point + intersect.normal * BIAS;
+            reflectedColor = castRay(Ray(origin, reflectDir), light, noise, recursion + 1,
+                                     pathDistance + intersect.dist, weight * compensation) * compensation;
+        } else if (!russianRoulette) {
+            reflectedColor = toRadiance(skybox.getColor(reflectDir));
+        }
     }
 
-    Color refractedColor(0.0f, 0.0f, 0.0f);
+    glm::vec3 refractedColor(0.0f);
     if (mat.transparency > 0) {
-        glm::vec3 origin = intersect.point - intersect.normal * BIAS;
+        float weight = throughput * mat.transparency;
         glm::vec3 refractDir = glm::refract(rayDirection, intersect.normal, mat.refractionIndex);
-        refractedColor = castRay(origin, refractDir, recursion + 1);
+        if (!canRecurse) {
+            refractedColor = toRadiance(skybox.getColor(refractDir));
+        } else if (shouldTrace(weight, compensation)) {
+            glm::vec3 origin = intersect.point - intersect.normal * BIAS;
+            refractedColor = castRay(Ray(origin, refractDir), light, noise, recursion + 1,
+                                     pathDistance + intersect.dist, weight * compensation) * compensation;
+        } else if (!russianRoulette) {
+            refractedColor = toRadiance(skybox.getColor(refractDir));
+        }
     }
 
+    // Local shading, including its shadow ray, is skipped when it can't visibly change the pixel
+    float localWeight = 1.0f - mat.reflectivity - mat.transparency;
+    Color localColor(0.0f, 0.0f, 0.0f);
+    if (localWeight > 0 && (russianRoulette || throughput * localWeight >= minThroughput)) {
+        float shadowIntensity = castShadow(intersect.point, lightDir, hitObject, light, noise);
+
+        float diffuseLightIntensity = std::max(0.0f, glm::dot(intersect.normal, lightDir));
+        float specLightIntensity = std::pow(std::max(0.0f, glm::dot(viewDir, reflectDir)), mat.specularCoefficient);
+
+        // Pixel footprint on the surface in world units (blocks are one unit wide), widened at grazing angles
+        float cosTheta = std::max(0.1f, std::abs(glm::dot(intersect.normal, rayDirection)));
+        float footprint = (pathDistance + intersect.dist) * PIXEL_SPREAD / cosTheta;
+        float lod = std::log2(std::max(1.0f, footprint * mat.tSize));
+
+        mat.diffuse = ImageLoader::sampleColor(mat.tKey, intersect.textureCoords.x * mat.tSize,
+                                               mat.tSize - (mat.tSize * intersect.textureCoords.y), lod) * 0.6f;
+        Color diffuseLight = mat.diffuse * light.intensity * diffuseLightIntensity * mat.albedo * shadowIntensity;
+        Color specularLight = light.color * light.intensity * specLightIntensity * mat.specularAlbedo * shadowIntensity;
+        localColor = (diffuseLight + specularLight) * localWeight;
+    }
 
-    mat.diffuse = ImageLoader::getPixelColor(hitObject->material.tKey, intersect.textureCoords.x * hitObject->material.tSize,
-                                             hitObject->material.tSize - (hitObject->material.tSize * intersect.textureCoords.y)) * 0.6f;
-    Color diffuseLight = mat.diffuse * light.intensity * diffuseLightIntensity * mat.albedo * shadowIntensity;
-    Color specularLight = light.color * light.intensity * specLightIntensity * mat.specularAlbedo * shadowIntensity;
-
-    Color color = (diffuseLight + specularLight) * (1.0f - mat.reflectivity - mat.transparency) + reflectedColor * mat.reflectivity + refractedColor * mat.transparency;
-    return color;
+    return toRadiance(localColor) + reflectedColor * mat.reflectivity + refractedColor * mat.transparency;
 } 
 
 void setUp() {
@@ -227,6 +419,8 @@ void setUp() {
             "glass"
     };
 
+    blockPalette = {Material{}, cherryPlanks, oakLog, cherryLeaves, acaciaLeaves, Basalt, redStoneLamp, Glass};
+
     const int gridWidth = 6;
     const float yOffset = 1.0f;
 
@@ -356,52 +550,352 @@ void setUp() {
 
 }
 
-void render() {
-    float fov = 3.1415/3;
-    for (int y = 0; y < SCREEN_HEIGHT; y++) {
-        for (int x = 0; x < SCREEN_WIDTH; x++) {
+// Sort the scene into what the visibility pre-pass rasterises and what it traces
+void prepareVisibility() {
+    if (!useVisibilityPrepass) {
+        return;
+    }
+    if (!visibility) {
+        visibility = new VisibilityBuffer(SCREEN_WIDTH, SCREEN_HEIGHT);
+    }
+    rasterCubes.clear();
+    rasterIds.clear();
+    tracedObjects.clear();
+    for (size_t i = 0; i < objects.size(); i++) {
+        if (auto cube = dynamic_cast<const Cube*>(objects[i])) {
+            rasterCubes.push_back(cube);
+            rasterIds.push_back(static_cast<int>(i));
+        } else {
+            tracedObjects.push_back(objects[i]);
+        }
+    }
+}
 
-            float screenX = (2.0f * (x + 0.5f)) / SCREEN_WIDTH - 1.0f;
-            float screenY = -(2.0f * (y + 0.5f)) / SCREEN_HEIGHT + 1.0f;
-            screenX *= ASPECT_RATIO;
-            screenX *= tan(fov/2.0f);
-            screenY *= tan(fov/2.0f);
+// Whether point lies inside or on the cube. The pre-pass only rasterises faces
+// seen from outside, so a cube holding the camera has nothing to show.
+bool cubeContains(const Cube& cube, const glm::vec3& point) {
+    glm::vec3 offset = glm::abs(point - cube.getCenter());
+    float half = cube.getSideLength() * 0.5f;
+    return offset.x <= half && offset.y <= half && offset.z <= half;
+}
 
+// Primary ray color starting from the visibility buffer; only the traced
+// objects are intersected, then shading proceeds as in castRay
+glm::vec3 castPrimaryRay(const Ray& ray, int x, int y, const Light& light, const glm::vec2& noise,
+                         const std::vector<Object*>& traced) {
+    Intersect intersect;
+    Object* hitObject = nullptr;
+    int id;
+    if (visibility->fetch(x, y, ray.origin, ray.direction, intersect, id)) {
+        hitObject = objects[id];
+    }
 
-            glm::vec3 cameraDir = glm::normalize(camera.target - camera.position);
+    for (Object* object : traced) {
+        Intersect i = object->rayIntersect(ray);
+        if (i.isIntersecting && (!hitObject || i.dist < intersect.dist)) {
+            hitObject = object;
+            intersect = i;
+        }
+    }
 
-            glm::vec3 cameraX = glm::normalize(glm::cross(cameraDir, camera.up));
-            glm::vec3 cameraY = glm::normalize(glm::cross(cameraX, cameraDir));
-            glm::vec3 rayDirection = glm::normalize(
-                cameraDir + cameraX * screenX + cameraY * screenY
-            );
+    if (!hitObject) {
+        return toRadiance(skybox.getColor(ray.direction));
+    }
+    return shade(ray, intersect, hitObject, light, noise, 0, 0.0f, 1.0f);
+}
 
-            Color pixelColor = castRay(camera.position, rayDirection);
-            /* Color pixelColor = castRay(glm::vec3(0,0,20), glm::normalize(glm::vec3(screenX, screenY, -1.0f))); */
+// Traces one frame into the framebuffer, tiles spread over the render pool.
+// Returns false as soon as the request is superseded by a newer one.
+bool render(const FrameRequest& request, Framebuffer& framebuffer) {
+    if (world) {
+        world->beginFrame();
+        world->prefetch(request.camera.position, WORLD_PREFETCH_RADIUS);
+    }
 
-            point(glm::vec2(x, y), pixelColor);
+    CameraBasis basis = CameraBasis::fromCamera(request.camera, FOV, SCREEN_WIDTH, SCREEN_HEIGHT);
+    const int tilesX = (SCREEN_WIDTH + RAY_TILE_SIZE - 1) / RAY_TILE_SIZE;
+    const int tilesY = (SCREEN_HEIGHT + RAY_TILE_SIZE - 1) / RAY_TILE_SIZE;
+
+    // Cubes the camera stands in are seen from the inside, which only the tracer
+    // handles, so they join the traced objects for this frame
+    std::vector<const Cube*> frameCubes;
+    std::vector<int> frameIds;
+    std::vector<Object*> frameTraced;
+    if (useVisibilityPrepass) {
+        frameTraced = tracedObjects;
+        for (size_t i = 0; i < rasterCubes.size(); i++) {
+            if (cubeContains(*rasterCubes[i], basis.origin)) {
+                frameTraced.push_back(objects[rasterIds[i]]);
+            } else {
+                frameCubes.push_back(rasterCubes[i]);
+                frameIds.push_back(rasterIds[i]);
+            }
         }
+        visibility->build(basis, frameCubes, frameIds, *renderPool);
     }
+    std::atomic<int> mismatches{0};
+
+    // Area lights and Russian roulette are noisy per frame, so average frames while the view is still
+    bool accumulate = request.light.radius > 0.0f || russianRoulette;
+    Uint32 sampleIndex = accumulate ? accumulator.begin(request.camera, request.light, request.sceneVersion) : 0;
+
+    renderPool->parallelFor(tilesX * tilesY, [&](int tile) {
+        if (request.stale()) {
+            return;
+        }
+        RayBatch batch;
+        batch.generate(basis, (tile % tilesX) * RAY_TILE_SIZE, (tile / tilesX) * RAY_TILE_SIZE,
+                       SCREEN_WIDTH, SCREEN_HEIGHT);
+
+        for (int i = 0; i < batch.count; i++) {
+            Ray ray = batch.ray(i);
+            glm::vec2 noise = pixelBlueNoise(batch.pixelX[i], batch.pixelY[i], sampleIndex);
+            glm::vec3 radiance;
+            if (useVisibilityPrepass) {
+                radiance = castPrimaryRay(ray, batch.pixelX[i], batch.pixelY[i], request.light, noise, frameTraced);
+                if (validateVisibility) {
+                    Color traced = toColor(castRay(ray, request.light, noise));
+                    Color fetched = toColor(radiance);
+                    if (std::abs(traced.r - fetched.r) > 2 || std::abs(traced.g - fetched.g) > 2 ||
+                        std::abs(traced.b - fetched.b) > 2) {
+                        mismatches++;
+                    }
+                }
+            } else {
+                radiance = castRay(ray, request.light, noise);
+            }
+            // Clamp to 8 bits only here, after any averaging, so boosted samples keep their energy
+            Color pixelColor = accumulate ? accumulator.add(batch.pixelX[i], batch.pixelY[i], radiance)
+                                          : toColor(radiance);
+            point(framebuffer, glm::vec2(batch.pixelX[i], batch.pixelY[i]), pixelColor);
+        }
+    });
+
+    if (useVisibilityPrepass && validateVisibility && !request.stale()) {
+        SDL_Log("Visibility pre-pass: %d of %d pixels differ from ray tracing", mismatches.load(),
+                SCREEN_WIDTH * SCREEN_HEIGHT);
+    }
+
+    if (world) {
+        world->trim();
+    }
+    if (request.stale()) {
+        return false;
+    }
+    if (accumulate) {
+        accumulator.end();
+    }
+    framebuffer.accumulatedFrames = accumulate ? accumulator.frameCount() : 0;
+    return true;
+}
+
+// Heap bytes currently handed out by malloc, in MB. Unlike resident memory this
+// drops as soon as something is freed, so before/after deltas isolate one scene.
+// Returns -1 where the C library has no way to ask (mallinfo2 is glibc 2.33+).
+double heapInUseMb() {
+#ifdef HAVE_MALLINFO2
+    struct mallinfo2 info = mallinfo2();
+    return static_cast<double>(info.uordblks + info.hblkhd) / (1024.0 * 1024.0);
+#else
+    return -1.0;
+#endif
+}
+
+struct BenchmarkResult {
+    double megapixelsPerSecond;
+    // Heap the scene still holds after rendering, over what was in use before it
+    // was built; -1 when heap statistics are unavailable
+    double memoryMb;
+};
+
+std::map<std::string, BenchmarkResult> loadBaseline(const std::string& path) {
+    std::map<std::string, BenchmarkResult> baseline;
+    std::ifstream in(path);
+    std::string name;
+    BenchmarkResult result;
+    while (in >> name >> result.megapixelsPerSecond >> result.memoryMb) {
+        baseline[name] = result;
+    }
+    return baseline;
+}
+
+// Render the house and every procedural scene from their fixed cameras, report
+// throughput and memory, and compare against the stored baseline. A scene is a
+// regression when it is slower, or uses more memory, than the baseline by more
+// than tolerance. Returns the process exit code.
+int runBenchmarks(const std::string& baselinePath, float tolerance, bool updateBaseline) {
+    // Only the palette is wanted here; the house is rebuilt inside its own measurement
+    setUp();
+    for (Object* object : objects) {
+        delete object;
+    }
+    objects.clear();
+
+    std::vector<BenchmarkScene> suite = makeBenchmarkScenes(blockPalette, GLASS, 1234);
+    suite.insert(suite.begin(), BenchmarkScene{"house", [] {
+        setUp();
+        std::vector<Object*> house;
+        std::swap(house, objects);
+        return house;
+    }, {camera}});
+
+    std::map<std::string, BenchmarkResult> baseline = loadBaseline(baselinePath);
+    std::map<std::string, BenchmarkResult> results;
+    Framebuffer framebuffer(SCREEN_WIDTH, SCREEN_HEIGHT);
+    std::atomic<Uint64> generation{0};
+    int regressions = 0;
+
+    for (auto& scene : suite) {
+        double heapBefore = heapInUseMb();
+        objects = scene.build();
+        prepareVisibility();
+
+        double bestSeconds = 0.0;
+        for (const Camera& view : scene.cameras) {
+            Light viewLight = light;
+            viewLight.position = view.position;
+            FrameRequest request{view, viewLight, 0, 0, &generation};
+
+            double best = 1e30;
+            for (int frame = 0; frame < BENCHMARK_FRAMES; frame++) {
+                auto start = std::chrono::steady_clock::now();
+                render(request, framebuffer);
+                std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                best = std::min(best, elapsed.count());
+            }
+            bestSeconds += best;
+        }
+
+        double pixels = static_cast<double>(SCREEN_WIDTH) * SCREEN_HEIGHT * scene.cameras.size();
+        double sceneMemory = heapBefore < 0.0 ? -1.0 : heapInUseMb() - heapBefore;
+        BenchmarkResult result{pixels / bestSeconds / 1e6, sceneMemory};
+        results[scene.name] = result;
+
+        std::string verdict = "new";
+        auto base = baseline.find(scene.name);
+        if (base != baseline.end()) {
+            bool slower = result.megapixelsPerSecond < base->second.megapixelsPerSecond * (1.0f - tolerance);
+            bool bigger = result.memoryMb >= 0.0 && base->second.memoryMb >= 0.0 &&
+                          result.memoryMb > base->second.memoryMb * (1.0f + tolerance) + BENCHMARK_MEMORY_SLACK_MB;
+            verdict = slower || bigger ? "REGRESSION" : "ok";
+            regressions += slower || bigger;
+        }
+        std::string memory = result.memoryMb < 0.0 ? "n/a" : std::to_string(result.memoryMb) + " MB";
+        std::cout << scene.name << ": " << result.megapixelsPerSecond << " Mpixel/s, "
+                  << memory << " scene memory, " << verdict << std::endl;
+
+        for (Object* object : objects) {
+            delete object;
+        }
+        objects.clear();
+    }
+
+    if (updateBaseline || baseline.empty()) {
+        std::ofstream out(baselinePath);
+        for (const auto& [name, result] : results) {
+            out << name << " " << result.megapixelsPerSecond << " " << result.memoryMb << "\n";
+        }
+        std::cout << "Baseline written to " << baselinePath << std::endl;
+    }
+
+    std::cout << regressions << " regression(s) beyond " << tolerance * 100.0f << "% tolerance" << std::endl;
+    return regressions > 0 ? 1 : 0;
+}
+
+// Rolling basalt terrain topped with planks and the odd leaf block, for trying out chunk worlds
+void generateWorld(const std::string& path, int chunksAcross) {
+    ChunkWorld::write(path, chunksAcross, 2, chunksAcross, [](int x, int y, int z) -> std::uint8_t {
+        int height = 10 + static_cast<int>(6.0f * std::sin(x * 0.05f) * std::cos(z * 0.07f));
+        if (y > height + 1) {
+            return AIR;
+        }
+        if (y == height + 1) {
+            return (x * 7 + z * 13) % 23 == 0 ? ACACIA_LEAVES : AIR;
+        }
+        return y == height ? CHERRY_PLANKS : BASALT;
+    });
 }
 
 int main(int argc, char* argv[]) {
+    std::string worldPath;
+    int generateChunks = 0;
+    size_t worldBudgetMb = 256;
+    bool benchmark = false;
+    bool updateBaseline = false;
+    std::string baselinePath = "../benchmark_baseline.txt";
+    float tolerance = 0.1f;
+    std::string exportName;
+    int exportSlots = DEFAULT_EXPORT_SLOTS;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--offline") {
+            russianRoulette = true;
+        } else if (arg == "--area-light" && i + 1 < argc) {
+            light.radius = std::stof(argv[++i]);
+        } else if (arg == "--min-throughput" && i + 1 < argc) {
+            minThroughput = std::stof(argv[++i]);
+        } else if (arg == "--world" && i + 1 < argc) {
+            worldPath = argv[++i];
+        } else if (arg == "--generate-world" && i + 2 < argc) {
+            worldPath = argv[++i];
+            generateChunks = std::stoi(argv[++i]);
+        } else if (arg == "--world-budget-mb" && i + 1 < argc) {
+            worldBudgetMb = std::stoul(argv[++i]);
+        } else if (arg == "--visibility-prepass") {
+            useVisibilityPrepass = true;
+        } else if (arg == "--validate-visibility") {
+            useVisibilityPrepass = true;
+            validateVisibility = true;
+        } else if (arg == "--benchmark") {
+            benchmark = true;
+        } else if (arg == "--baseline" && i + 1 < argc) {
+            baselinePath = argv[++i];
+        } else if (arg == "--tolerance" && i + 1 < argc) {
+            tolerance = std::stof(argv[++i]);
+        } else if (arg == "--update-baseline") {
+            updateBaseline = true;
+        } else if (arg == "--export-frames" && i + 1 < argc) {
+            exportName = argv[++i];
+        } else if (arg == "--export-slots" && i + 1 < argc) {
+            exportSlots = std::max(2, std::stoi(argv[++i]));
+        }
+    }
+
     // Initialize SDL
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
         SDL_Log("Unable to initialize SDL: %s", SDL_GetError());
         return 1;
     }
 
+    ThreadPool pool;
+    renderPool = &pool;
+
     ImageLoader::init(); // Imageloader for textures
-    ImageLoader::loadImage("cherryLeaves", "../textures/cherry_leaves.png");
-    ImageLoader::loadImage("cherryPlanks", "../textures/cherry_planks.png");
-    ImageLoader::loadImage("oakLog", "../textures/oak_log_s.png");
-    ImageLoader::loadImage("cherryDoorB", "../textures/cherry_door_bottom.png");
-    ImageLoader::loadImage("cherryDoorT", "../textures/cherry_door_top.png");
-    ImageLoader::loadImage("acaciaLeaves", "../textures/azalea_leaves.png");
-    ImageLoader::loadImage("redStoneLamp", "../textures/redstone_lamp.png");
-    ImageLoader::loadImage("basalt", "../textures/basalt.png");
-    ImageLoader::loadImage("glass", "../textures/pink_glass.png");
 
+    // The skybox is the largest asset, so it finishes in the background while
+    // the textures decode in parallel and the first frames show a flat sky
+    skybox.loadAsync("../BG/skybox.png", pool);
+
+    ImageLoader::loadImages({
+            {"cherryLeaves", "../textures/cherry_leaves.png"},
+            {"cherryPlanks", "../textures/cherry_planks.png"},
+            {"oakLog", "../textures/oak_log_s.png"},
+            {"cherryDoorB", "../textures/cherry_door_bottom.png"},
+            {"cherryDoorT", "../textures/cherry_door_top.png"},
+            {"acaciaLeaves", "../textures/azalea_leaves.png"},
+            {"redStoneLamp", "../textures/redstone_lamp.png"},
+            {"basalt", "../textures/basalt.png"},
+            {"glass", "../textures/pink_glass.png"},
+    }, pool);
+
+    // Headless benchmark run; no window needed
+    if (benchmark) {
+        skybox.wait();
+        int result = runBenchmarks(baselinePath, tolerance, updateBaseline);
+        SDL_Quit();
+        return result;
+    }
 
     // Create a window
     SDL_Window* window = SDL_CreateWindow("Hello World - FPS: 0", 
@@ -425,7 +919,22 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
+    // Finished frames are streamed into this texture instead of drawn point by point
+    SDL_Texture* frameTexture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING,
+                                                  SCREEN_WIDTH, SCREEN_HEIGHT);
+
+    if (!frameTexture) {
+        SDL_Log("Unable to create frame texture: %s", SDL_GetError());
+        SDL_DestroyRenderer(renderer);
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+        return 1;
+    }
+
     bool running = true;
+    bool sceneDirty = true;
+    bool skyboxShown = false;
+    Uint64 sceneVersion = 0;
     SDL_Event event;
 
     int frameCount = 0;
@@ -434,14 +943,52 @@ int main(int argc, char* argv[]) {
     
     setUp();
 
+    if (!worldPath.empty()) {
+        try {
+            if (generateChunks > 0) {
+                generateWorld(worldPath, generateChunks);
+            }
+            // Sink the world so its surface sits just below the house
+            world = new ChunkWorld(worldPath, blockPalette, glm::vec3(0.0f), worldBudgetMb * 1024 * 1024);
+            glm::vec3 size = world->sizeInBlocks();
+            world->setOffset(glm::vec3(-size.x / 2.0f, -18.0f, -size.z / 2.0f));
+            objects.push_back(world);
+        } catch (const std::exception& e) {
+            SDL_Log("Unable to load world: %s", e.what());
+        }
+    }
+    prepareVisibility();
+
+    // Publish finished frames for other processes; declared first so it outlives the render thread
+    std::unique_ptr<FrameExporter> exporter;
+    if (!exportName.empty()) {
+        try {
+            exporter = std::make_unique<FrameExporter>(exportName, SCREEN_WIDTH, SCREEN_HEIGHT, exportSlots);
+        } catch (const std::exception& e) {
+            SDL_Log("Unable to export frames: %s", e.what());
+        }
+    }
+    RenderThread::FrameSink frameSink;
+    if (exporter) {
+        frameSink = [&exporter](const Framebuffer& framebuffer) {
+            exporter->publish(framebuffer.frameNumber, framebuffer.accumulatedFrames, framebuffer.pixels.data());
+        };
+    }
+
+    RenderThread renderThread(SCREEN_WIDTH, SCREEN_HEIGHT, render, frameSink);
+
     while (running) {
-        light.position = camera.position;
-        while (SDL_PollEvent(&event)) {
+        // Block briefly for input so an idle scene costs next to nothing
+        if (!SDL_WaitEventTimeout(&event, 10)) {
+            event.type = 0;
+        }
+        do {
             if (event.type == SDL_QUIT) {
                 running = false;
             }
 
             if (event.type == SDL_KEYDOWN) {
+                sceneDirty = true;
                 switch(event.key.keysym.sym) {
                     case SDLK_UP:
                         camera.move(-1.0f);
@@ -458,20 +1005,41 @@ int main(int argc, char* argv[]) {
                         camera.rotate(1.0f, -1.0f);
                  }
             }
+        } while (SDL_PollEvent(&event));
 
+        // Re-render once the background skybox load lands
+        if (!skyboxShown && skybox.isReady()) {
+            skyboxShown = true;
+            sceneVersion++;
+            sceneDirty = true;
+        }
 
+        // Only trace when something changed; a newer request cancels the one in flight
+        if (sceneDirty) {
+            light.position = camera.position;
+            renderThread.request(camera, light, sceneVersion);
+            sceneDirty = false;
         }
 
-        // Clear the screen
-        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-        SDL_RenderClear(renderer);
+        bool newFrame = renderThread.consumeFrame([&](const Framebuffer& framebuffer) {
+            SDL_UpdateTexture(frameTexture, nullptr, framebuffer.pixels.data(), framebuffer.pitch());
+            // Keep refining a still view until enough frames are averaged
+            if (framebuffer.accumulatedFrames > 0 && framebuffer.accumulatedFrames < TEMPORAL_FRAMES) {
+                sceneDirty = true;
+            }
+        });
 
-        render();
+        if (newFrame) {
+            // Clear the screen
+            SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+            SDL_RenderClear(renderer);
+            SDL_RenderCopy(renderer, frameTexture, nullptr, nullptr);
 
-        // Present the renderer
-        SDL_RenderPresent(renderer);
+            // Present the renderer
+            SDL_RenderPresent(renderer);
 
-        frameCount++;
+            frameCount++;
+        }
 
         // Calculate and display FPS
         if (SDL_GetTicks() - currentTime >= 1000) {
@@ -483,6 +1051,7 @@ int main(int argc, char* argv[]) {
     }
 
     // Cleanup
+    SDL_DestroyTexture(frameTexture);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     SDL_Quit();
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <string>
 #include "color.h"
 
 struct Material {
@@ -12,4 +13,5 @@ struct Material {
   float refractionIndex;
   int tSize;
   std::string tKey;
+  int maxRecursion = 0; // Deepest bounce for rays leaving this material, 0 uses MAX_RECURSION
 };
@@ -3,11 +3,23 @@
 #include <glm/glm.hpp>
 #include "material.h"
 #include "intersect.h"
+#include "ray.h"
 
 class Object {
 public:
   Object(const Material& mat) : material(mat) {}
+  virtual ~Object() = default;
   virtual Intersect rayIntersect(const glm::vec3& rayOrigin, const glm::vec3& rayDirection) const = 0;
+
+  // Objects that benefit from the precomputed reciprocal direction override this
+  virtual Intersect rayIntersect(const Ray& ray) const {
+    return rayIntersect(ray.origin, ray.direction);
+  }
+
+  // Whether parts of this object can shadow other parts of it
+  virtual bool canShadowItself() const {
+    return false;
+  }
   
   Material material;
 };
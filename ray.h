@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+
+// A ray with its reciprocal direction and direction signs precomputed, so the
+// slab tests against every object don't each redo the divisions.
+struct Ray {
+    glm::vec3 origin;
+    glm::vec3 direction;
+    glm::vec3 invDirection;
+    int sign[3];
+
+    Ray(const glm::vec3& origin, const glm::vec3& direction)
+            : Ray(origin, direction, 1.0f / direction) {}
+
+    Ray(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& invDirection)
+            : origin(origin), direction(direction), invDirection(invDirection) {
+        sign[0] = invDirection.x < 0;
+        sign[1] = invDirection.y < 0;
+        sign[2] = invDirection.z < 0;
+    }
+
+    // Signs already packed as bits 0/1/2 for negative x/y/z, as ray generation produces them
+    Ray(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& invDirection, std::uint8_t signBits)
+            : origin(origin), direction(direction), invDirection(invDirection) {
+        sign[0] = signBits & 1;
+        sign[1] = (signBits >> 1) & 1;
+        sign[2] = (signBits >> 2) & 1;
+    }
+};
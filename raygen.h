@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "camera.h"
+#include "ray.h"
+
+const int RAY_TILE_SIZE = 8;
+const int RAY_BATCH_SIZE = RAY_TILE_SIZE * RAY_TILE_SIZE;
+
+// Camera basis computed once per frame. The direction through pixel (x, y) is
+// topLeft + stepRight * x + stepDown * y before normalisation, so generating a
+// ray costs one normalise and one reciprocal instead of rebuilding the basis.
+struct CameraBasis {
+    glm::vec3 origin;
+    glm::vec3 forward;
+    glm::vec3 topLeft;
+    glm::vec3 stepRight;
+    glm::vec3 stepDown;
+
+    static CameraBasis fromCamera(const Camera& camera, float fov, int width, int height) {
+        float aspectRatio = static_cast<float>(width) / static_cast<float>(height);
+        float tanHalfFov = std::tan(fov / 2.0f);
+
+        glm::vec3 cameraDir = glm::normalize(camera.target - camera.position);
+        glm::vec3 cameraX = glm::normalize(glm::cross(cameraDir, camera.up));
+        glm::vec3 cameraY = glm::normalize(glm::cross(cameraX, cameraDir));
+
+        glm::vec3 right = cameraX * (aspectRatio * tanHalfFov);
+        glm::vec3 up = cameraY * tanHalfFov;
+
+        CameraBasis basis;
+        basis.origin = camera.position;
+        basis.forward = cameraDir;
+        basis.stepRight = right * (2.0f / width);
+        basis.stepDown = up * (-2.0f / height);
+        // Centre of pixel (0, 0)
+        basis.topLeft = cameraDir - right + up + (basis.stepRight + basis.stepDown) * 0.5f;
+        return basis;
+    }
+
+    glm::vec3 direction(int x, int y) const {
+        return glm::normalize(topLeft + stepRight * static_cast<float>(x) + stepDown * static_cast<float>(y));
+    }
+
+    // Inverse of direction(): continuous pixel coordinates a world point projects to.
+    // Returns false for points at or behind the camera plane.
+    bool project(const glm::vec3& point, glm::vec2& pixel) const {
+        glm::vec3 v = point - origin;
+        float depth = glm::dot(v, forward);
+        if (depth <= 1e-4f) {
+            return false;
+        }
+        glm::vec3 onPlane = v / depth - topLeft;
+        pixel.x = glm::dot(onPlane, stepRight) / glm::dot(stepRight, stepRight);
+        pixel.y = glm::dot(onPlane, stepDown) / glm::dot(stepDown, stepDown);
+        return true;
+    }
+};
+
+// One screen tile of primary rays in structure-of-arrays form. Lanes are
+// contiguous per component so packet code can load them straight into vector
+// registers; ray(i) gathers a lane back into a Ray for the scalar path.
+struct RayBatch {
+    alignas(32) float originX[RAY_BATCH_SIZE];
+    alignas(32) float originY[RAY_BATCH_SIZE];
+    alignas(32) float originZ[RAY_BATCH_SIZE];
+    alignas(32) float dirX[RAY_BATCH_SIZE];
+    alignas(32) float dirY[RAY_BATCH_SIZE];
+    alignas(32) float dirZ[RAY_BATCH_SIZE];
+    alignas(32) float invDirX[RAY_BATCH_SIZE];
+    alignas(32) float invDirY[RAY_BATCH_SIZE];
+    alignas(32) float invDirZ[RAY_BATCH_SIZE];
+    // Bit 0/1/2 set when the x/y/z direction is negative
+    alignas(32) std::uint8_t signs[RAY_BATCH_SIZE];
+    std::uint16_t pixelX[RAY_BATCH_SIZE];
+    std::uint16_t pixelY[RAY_BATCH_SIZE];
+    int count = 0;
+
+    // Fill the batch with the rays of the tile starting at (x0, y0), clipped to the screen
+    void generate(const CameraBasis& basis, int x0, int y0, int width, int height) {
+        int x1 = std::min(x0 + RAY_TILE_SIZE, width);
+        int y1 = std::min(y0 + RAY_TILE_SIZE, height);
+
+        count = 0;
+        for (int y = y0; y < y1; y++) {
+            glm::vec3 rowStart = basis.topLeft + basis.stepDown * static_cast<float>(y);
+            for (int x = x0; x < x1; x++) {
+                glm::vec3 dir = glm::normalize(rowStart + basis.stepRight * static_cast<float>(x));
+                glm::vec3 invDir = 1.0f / dir;
+
+                originX[count] = basis.origin.x;
+                originY[count] = basis.origin.y;
+                originZ[count] = basis.origin.z;
+                dirX[count] = dir.x;
+                dirY[count] = dir.y;
+                dirZ[count] = dir.z;
+                invDirX[count] = invDir.x;
+                invDirY[count] = invDir.y;
+                invDirZ[count] = invDir.z;
+                signs[count] = static_cast<std::uint8_t>((invDir.x < 0) | (invDir.y < 0) << 1 | (invDir.z < 0) << 2);
+                pixelX[count] = static_cast<std::uint16_t>(x);
+                pixelY[count] = static_cast<std::uint16_t>(y);
+                count++;
+            }
+        }
+    }
+
+    Ray ray(int i) const {
+        return Ray(glm::vec3(originX[i], originY[i], originZ[i]),
+                   glm::vec3(dirX[i], dirY[i], dirZ[i]),
+                   glm::vec3(invDirX[i], invDirY[i], invDirZ[i]), signs[i]);
+    }
+};
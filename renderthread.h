@@ -0,0 +1,123 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include "camera.h"
+#include "framebuffer.h"
+#include "light.h"
+
+// Everything a frame needs from the UI thread, copied so the UI can keep
+// mutating its own camera and light while the frame is being traced.
+struct FrameRequest {
+    Camera camera;
+    Light light;
+    // Bumped by the UI whenever the scene changes without the camera or light moving
+    Uint64 sceneVersion;
+    Uint64 generation;
+    const std::atomic<Uint64>* latestGeneration;
+
+    // True once a newer request has been made; the tracer should bail out
+    bool stale() const {
+        return latestGeneration->load(std::memory_order_relaxed) != generation;
+    }
+};
+
+// Traces frames on a dedicated thread into a back buffer and swaps it with the
+// front buffer once complete. The UI thread only requests frames and picks up
+// the latest finished one; when nothing is requested the thread sleeps.
+class RenderThread {
+public:
+    // Returns false if the frame was abandoned because it went stale
+    using RenderFunc = std::function<bool(const FrameRequest&, Framebuffer&)>;
+    // Sees every finished frame on the render thread, before the UI does
+    using FrameSink = std::function<void(const Framebuffer&)>;
+
+    RenderThread(int width, int height, RenderFunc renderFunc, FrameSink frameSink = nullptr)
+            : front(width, height), back(width, height), renderFunc(std::move(renderFunc)),
+              frameSink(std::move(frameSink)) {
+        worker = std::thread([this] { workerLoop(); });
+    }
+
+    ~RenderThread() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        // Make any in-flight frame stale so shutdown doesn't wait for it
+        latestGeneration++;
+        wakeUp.notify_one();
+        worker.join();
+    }
+
+    RenderThread(const RenderThread&) = delete;
+    RenderThread& operator=(const RenderThread&) = delete;
+
+    // Ask for a new frame, superseding both the pending and the in-flight one
+    void request(const Camera& camera, const Light& light, Uint64 sceneVersion = 0) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            Uint64 generation = ++latestGeneration;
+            pending = FrameRequest{camera, light, sceneVersion, generation, &latestGeneration};
+        }
+        wakeUp.notify_one();
+    }
+
+    // Hand the newest finished frame to fn, if one arrived since the last call
+    template <typename F>
+    bool consumeFrame(F&& fn) {
+        std::lock_guard<std::mutex> lock(frontMutex);
+        if (!frontReady) {
+            return false;
+        }
+        fn(static_cast<const Framebuffer&>(front));
+        frontReady = false;
+        return true;
+    }
+
+private:
+    Framebuffer front;
+    Framebuffer back;
+    bool frontReady = false;
+    std::mutex frontMutex;
+
+    std::optional<FrameRequest> pending;
+    bool stopping = false;
+    std::atomic<Uint64> latestGeneration{0};
+    Uint64 framesCompleted = 0;
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+
+    RenderFunc renderFunc;
+    FrameSink frameSink;
+    std::thread worker;
+
+    void workerLoop() {
+        while (true) {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeUp.wait(lock, [this] { return stopping || pending.has_value(); });
+            if (stopping) {
+                return;
+            }
+            FrameRequest job = *pending;
+            pending.reset();
+            lock.unlock();
+
+            if (!renderFunc(job, back) || job.stale()) {
+                continue;
+            }
+
+            back.frameNumber = ++framesCompleted;
+            if (frameSink) {
+                frameSink(back);
+            }
+            std::lock_guard<std::mutex> frontLock(frontMutex);
+            std::swap(front, back);
+            frontReady = true;
+        }
+    }
+};
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "camera.h"
+#include "cube.h"
+#include "material.h"
+#include "object.h"
+#include "sphere.h"
+
+// Seeded procedural scenes for measuring how rendering scales with scene size
+// and material mix. Generators draw materials from a block palette where index
+// 0 is air and glassId names the transparent material.
+
+// A flat square of count blocks, one layer deep
+inline std::vector<Object*> makeFlatTerrain(int count, const std::vector<Material>& palette, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<size_t> pick(1, palette.size() - 1);
+    std::vector<Object*> scene;
+
+    int side = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(count))));
+    for (int i = 0; i < count; i++) {
+        int x = i % side - side / 2;
+        int z = i / side - side / 2;
+        scene.push_back(new Cube(glm::vec3(x, -1.0f, z), 1.0f, palette[pick(rng)]));
+    }
+    return scene;
+}
+
+// count unit cubes scattered through a box that grows with the count, so density stays roughly constant
+inline std::vector<Object*> makeRandomCubes(int count, const std::vector<Material>& palette, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<size_t> pick(1, palette.size() - 1);
+    float extent = std::cbrt(static_cast<float>(count)) * 1.5f;
+    std::uniform_real_distribution<float> coord(-extent, extent);
+    std::vector<Object*> scene;
+
+    for (int i = 0; i < count; i++) {
+        glm::vec3 center(std::round(coord(rng)), std::round(coord(rng)), std::round(coord(rng)) - extent);
+        scene.push_back(new Cube(center, 1.0f, palette[pick(rng)]));
+    }
+    return scene;
+}
+
+// Stacked walls of glass blocks, so most rays pass through several panes
+inline std::vector<Object*> makeGlassScene(int count, const std::vector<Material>& palette, int glassId, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<size_t> pick(1, palette.size() - 1);
+    std::vector<Object*> scene;
+
+    int side = std::max(1, static_cast<int>(std::sqrt(count / 3.0f)));
+    for (int i = 0; i < count; i++) {
+        int layer = i / (side * side);
+        int x = i % side - side / 2;
+        int y = (i / side) % side - side / 2;
+        // Every fourth layer is opaque so rays eventually stop somewhere
+        size_t material = layer % 4 == 3 ? pick(rng) : static_cast<size_t>(glassId);
+        scene.push_back(new Cube(glm::vec3(x, y, -layer * 1.5f), 1.0f, palette[material]));
+    }
+    return scene;
+}
+
+// count spheres of random size and material on a jittered grid
+inline std::vector<Object*> makeSpheres(int count, const std::vector<Material>& palette, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<size_t> pick(1, palette.size() - 1);
+    std::uniform_real_distribution<float> jitter(-0.3f, 0.3f);
+    std::uniform_real_distribution<float> radius(0.2f, 0.5f);
+    std::vector<Object*> scene;
+
+    int side = static_cast<int>(std::ceil(std::cbrt(static_cast<float>(count))));
+    for (int i = 0; i < count; i++) {
+        glm::vec3 center(i % side - side / 2 + jitter(rng),
+                         (i / side) % side - side / 2 + jitter(rng),
+                         -(i / (side * side)) - 1.0f + jitter(rng));
+        scene.push_back(new Sphere(center, radius(rng), palette[pick(rng)]));
+    }
+    return scene;
+}
+
+// One entry of the benchmark suite: how to build the scene and where to look at it from
+struct BenchmarkScene {
+    std::string name;
+    std::function<std::vector<Object*>()> build;
+    std::vector<Camera> cameras;
+};
+
+inline std::vector<BenchmarkScene> makeBenchmarkScenes(const std::vector<Material>& palette, int glassId, unsigned seed) {
+    glm::vec3 up(0.0f, 1.0f, 0.0f);
+    std::vector<BenchmarkScene> suite;
+
+    for (int count : {256, 1024}) {
+        float side = std::sqrt(static_cast<float>(count));
+        suite.push_back({"terrain-" + std::to_string(count),
+                         [=, &palette] { return makeFlatTerrain(count, palette, seed); },
+                         {Camera(glm::vec3(0.0f, side * 0.4f, side * 0.7f), glm::vec3(0.0f), up, 10.0f),
+                          Camera(glm::vec3(side * 0.5f, 2.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f), up, 10.0f)}});
+    }
+    for (int count : {128, 512}) {
+        float extent = std::cbrt(static_cast<float>(count)) * 1.5f;
+        suite.push_back({"cubes-" + std::to_string(count),
+                         [=, &palette] { return makeRandomCubes(count, palette, seed); },
+                         {Camera(glm::vec3(0.0f, 0.0f, extent * 1.5f), glm::vec3(0.0f, 0.0f, -extent), up, 10.0f)}});
+    }
+    for (int count : {96, 384}) {
+        suite.push_back({"glass-" + std::to_string(count),
+                         [=, &palette] { return makeGlassScene(count, palette, glassId, seed); },
+                         {Camera(glm::vec3(0.0f, 0.0f, 8.0f), glm::vec3(0.0f, 0.0f, -4.0f), up, 10.0f)}});
+    }
+    for (int count : {64, 512}) {
+        float side = std::cbrt(static_cast<float>(count));
+        suite.push_back({"spheres-" + std::to_string(count),
+                         [=, &palette] { return makeSpheres(count, palette, seed); },
+                         {Camera(glm::vec3(0.0f, 0.0f, side + 2.0f), glm::vec3(0.0f, 0.0f, -side / 2.0f), up, 10.0f)}});
+    }
+    return suite;
+}
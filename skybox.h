@@ -1,25 +1,53 @@
 #pragma once
 
+#include <atomic>
+#include <future>
+#include <memory>
 #include <string>
 #include <stdexcept>
+#include <vector>
 #include "SDL_image.h"
 #include "glm/glm.hpp"
 #include "color.h"
+#include "assetcache.h"
+#include "threadpool.h"
 
 class Skybox {
 public:
-    Skybox(const std::string& textureFile) {
-        loadTexture(textureFile);
+    Skybox() = default;
+
+    Skybox(const Skybox&) = delete;
+    Skybox& operator=(const Skybox&) = delete;
+
+    // Start loading the texture on the pool. Until it is ready getColor
+    // returns a flat sky color, so the first frames don't wait on the decode.
+    void loadAsync(const std::string& textureFile, ThreadPool& pool) {
+        loading = pool.submit([this, textureFile] {
+            try {
+                loadTexture(textureFile);
+                ready.store(true, std::memory_order_release);
+            } catch (const std::exception& e) {
+                SDL_Log("%s", e.what());
+            }
+        });
+    }
+
+    bool isReady() const {
+        return ready.load(std::memory_order_acquire);
     }
 
-    ~Skybox() {
-        if (texture) {
-            SDL_FreeSurface(texture);
-            texture = nullptr;
+    // Block until a pending load has finished, successfully or not
+    void wait() {
+        if (loading.valid()) {
+            loading.wait();
         }
     }
 
     Color getColor(const glm::vec3& direction) const {
+        if (!isReady()) {
+            return fallback;
+        }
+
         // Convert direction vector to spherical coordinates
         float phi = atan2(direction.z, direction.x);
         float theta = acos(direction.y);
@@ -29,16 +57,16 @@ public:
         float v = theta / M_PI;
 
         // Map texture coordinates to pixel coordinates
-        int x = static_cast<int>(u * texture->w) % texture->w;
-        int y = static_cast<int>(v * texture->h) % texture->h;
+        int x = static_cast<int>(u * width) % width;
+        int y = static_cast<int>(v * height) % height;
 
         // Ensure x and y are within the valid range
-        x = std::max(0, std::min(texture->w - 1, x));
-        y = std::max(0, std::min(texture->h - 1, y));
+        x = std::max(0, std::min(width - 1, x));
+        y = std::max(0, std::min(height - 1, y));
 
         // Get pixel color from texture
         Uint8 r, g, b;
-        Uint8* pixel = &((Uint8*)texture->pixels)[3 * (y * texture->w + x)];
+        const Uint8* pixel = &pixels[3 * (y * width + x)];
         r = pixel[0];
         g = pixel[1];
         b = pixel[2];
@@ -47,19 +75,54 @@ public:
     }
 
 private:
-    SDL_Surface* texture = nullptr;
+    // Shown until the texture is ready
+    Color fallback = Color(170, 200, 235);
+
+    // Tightly packed RGB24, either decoded here or mapped from the asset cache
+    std::vector<Uint8> decoded;
+    std::shared_ptr<MappedFile> cached;
+    const Uint8* pixels = nullptr;
+    int width = 0;
+    int height = 0;
+
+    std::atomic<bool> ready{false};
+    std::future<void> loading;
 
     void loadTexture(const std::string& textureFile) {
+        AssetCacheHeader header;
+        cached = AssetCache::lookup("skybox", textureFile, ASSET_RGB24, header);
+        if (cached && header.width > 0 && header.height > 0 &&
+            cached->size() >= sizeof(header) + static_cast<size_t>(header.width) * header.height * 3) {
+            width = static_cast<int>(header.width);
+            height = static_cast<int>(header.height);
+            pixels = cached->data() + sizeof(header);
+            return;
+        }
+        cached.reset();
+
         SDL_Surface* rawTexture = IMG_Load(textureFile.c_str());
         if (!rawTexture) {
             throw std::runtime_error("Failed to load skybox texture: " + std::string(IMG_GetError()));
         }
         // Convert the loaded image to RGB format
-        texture = SDL_ConvertSurfaceFormat(rawTexture, SDL_PIXELFORMAT_RGB24, 0);
+        SDL_Surface* texture = SDL_ConvertSurfaceFormat(rawTexture, SDL_PIXELFORMAT_RGB24, 0);
         if (!texture) {
             SDL_FreeSurface(rawTexture);
             throw std::runtime_error("Failed to convert skybox texture to RGB: " + std::string(SDL_GetError()));
         }
         SDL_FreeSurface(rawTexture);
+
+        // Drop the row padding so rows can be indexed directly
+        width = texture->w;
+        height = texture->h;
+        decoded.resize(static_cast<size_t>(width) * height * 3);
+        for (int y = 0; y < height; y++) {
+            const Uint8* row = static_cast<const Uint8*>(texture->pixels) + static_cast<size_t>(y) * texture->pitch;
+            std::copy(row, row + width * 3, decoded.begin() + static_cast<size_t>(y) * width * 3);
+        }
+        SDL_FreeSurface(texture);
+        pixels = decoded.data();
+
+        AssetCache::store("skybox", textureFile, ASSET_RGB24, width, height, decoded.data(), decoded.size());
     }
 };
@@ -10,6 +10,8 @@ public:
     Sphere(const glm::vec3& center, float radius, const Material& mat)
             : center(center), radius(radius), Object(mat) {}
 
+    using Object::rayIntersect;
+
     Intersect rayIntersect(const glm::vec3& rayOrigin, const glm::vec3& rayDirection) const {
         glm::vec3 oc = rayOrigin - center;
 
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <SDL2/SDL.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "color.h"
+
+// Texture stored as a chain of power-of-two mip levels, each in Morton (Z-order)
+// layout. Neighbouring texels in both u and v land on the same cache lines, and
+// distant surfaces read from the small levels, which stay resident in cache.
+//
+// All levels sit back to back in one block, largest first, so a texture can be
+// written to disk and later used straight from a memory mapping.
+class MipTexture {
+public:
+    MipTexture() = default;
+
+    // Build from tightly or loosely packed RGBA32 pixels. Non power-of-two or
+    // non-square images are resampled (nearest) up to the next square power of two.
+    MipTexture(int width, int height, int pitch, const Uint8* pixels) {
+        int size = 1;
+        while (size < width || size < height) {
+            size <<= 1;
+        }
+        setLevels(size);
+
+        auto storage = std::make_shared<std::vector<Color>>(texelCount(size));
+        Color* base = storage->data();
+        for (int y = 0; y < size; y++) {
+            const Uint8* row = pixels + static_cast<size_t>(y * height / size) * pitch;
+            for (int x = 0; x < size; x++) {
+                const Uint8* p = row + static_cast<size_t>(x * width / size) * 4;
+                base[morton(x, y)] = Color(p[0], p[1], p[2], p[3]);
+            }
+        }
+        for (int level = 1; level < levelCount(); level++) {
+            downsample(base + levelOffsets[level - 1], base + levelOffsets[level], size >> level);
+        }
+
+        texels = base;
+        owner = storage;
+    }
+
+    // Use levels already laid out back to back somewhere owner keeps alive,
+    // such as a memory-mapped cache file
+    MipTexture(int baseSize, const Color* texels, std::shared_ptr<const void> owner)
+            : texels(texels), owner(std::move(owner)) {
+        setLevels(baseSize);
+    }
+
+    int size() const {
+        return baseSize;
+    }
+
+    int levelCount() const {
+        return static_cast<int>(levelOffsets.size());
+    }
+
+    // The whole chain, for writing it out
+    const Color* data() const {
+        return texels;
+    }
+
+    static size_t texelCount(int baseSize) {
+        size_t count = 0;
+        for (int size = baseSize; size >= 1; size >>= 1) {
+            count += static_cast<size_t>(size) * size;
+        }
+        return count;
+    }
+
+    // Point fetch from a level; x and y are in that level's texels and wrap around
+    Color fetch(int level, int x, int y) const {
+        int mask = (baseSize >> level) - 1;
+        return texels[levelOffsets[level] + morton(x & mask, y & mask)];
+    }
+
+    // Point sample the nearest mip level. x and y are in level-0 texels and lod is
+    // log2 of how many level-0 texels one pixel covers.
+    Color sample(float x, float y, float lod) const {
+        int level = std::clamp(static_cast<int>(lod + 0.5f), 0, levelCount() - 1);
+        int xi = static_cast<int>(std::floor(x)) >> level;
+        int yi = static_cast<int>(std::floor(y)) >> level;
+        return fetch(level, xi, yi);
+    }
+
+private:
+    const Color* texels = nullptr;
+    std::shared_ptr<const void> owner;
+    int baseSize = 0;
+    std::vector<size_t> levelOffsets;
+
+    void setLevels(int size) {
+        baseSize = size;
+        levelOffsets.clear();
+        size_t offset = 0;
+        for (; size >= 1; size >>= 1) {
+            levelOffsets.push_back(offset);
+            offset += static_cast<size_t>(size) * size;
+        }
+    }
+
+    // Interleave the bits of x and y (x in the even bits)
+    static size_t morton(int x, int y) {
+        return spreadBits(static_cast<std::uint32_t>(x)) | (spreadBits(static_cast<std::uint32_t>(y)) << 1);
+    }
+
+    static size_t spreadBits(std::uint32_t v) {
+        v &= 0x0000ffff;
+        v = (v | (v << 8)) & 0x00ff00ff;
+        v = (v | (v << 4)) & 0x0f0f0f0f;
+        v = (v | (v << 2)) & 0x33333333;
+        v = (v | (v << 1)) & 0x55555555;
+        return v;
+    }
+
+    // 2x2 box filter from a level into the next one, which is size texels across
+    static void downsample(const Color* src, Color* dst, int size) {
+        for (int y = 0; y < size; y++) {
+            for (int x = 0; x < size; x++) {
+                // The 2x2 block of the parent is contiguous in Morton order
+                const Color* block = &src[morton(x * 2, y * 2)];
+                int r = 0, g = 0, b = 0, a = 0;
+                for (int i = 0; i < 4; i++) {
+                    r += block[i].r;
+                    g += block[i].g;
+                    b += block[i].b;
+                    a += block[i].a;
+                }
+                dst[morton(x, y)] = Color((r + 2) / 4, (g + 2) / 4, (b + 2) / 4, (a + 2) / 4);
+            }
+        }
+    }
+};
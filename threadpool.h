@@ -0,0 +1,98 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned threadCount = std::thread::hardware_concurrency()) {
+        threadCount = std::max(1u, threadCount);
+        for (unsigned i = 0; i < threadCount; ++i) {
+            workers.emplace_back([this] { workerLoop(); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const {
+        return workers.size();
+    }
+
+    // Queue a task and get a future for its result
+    template <typename F>
+    auto submit(F&& task) -> std::future<decltype(task())> {
+        using Result = decltype(task());
+        auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+        std::future<Result> result = packaged->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.emplace([packaged] { (*packaged)(); });
+        }
+        wakeUp.notify_one();
+        return result;
+    }
+
+    // Run body(i) for every i in [0, count), with the calling thread helping out.
+    // Indices are handed out one at a time so uneven rows balance themselves.
+    void parallelFor(int count, const std::function<void(int)>& body) {
+        std::atomic<int> next{0};
+        auto drain = [&] {
+            for (int i = next++; i < count; i = next++) {
+                body(i);
+            }
+        };
+
+        std::vector<std::future<void>> pending;
+        size_t helpers = std::min(workers.size(), static_cast<size_t>(std::max(0, count - 1)));
+        for (size_t i = 0; i < helpers; ++i) {
+            pending.push_back(submit(drain));
+        }
+        drain();
+        for (auto& f : pending) {
+            f.get();
+        }
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    bool stopping = false;
+
+    void workerLoop() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wakeUp.wait(lock, [this] { return stopping || !tasks.empty(); });
+                if (stopping && tasks.empty()) {
+                    return;
+                }
+                task = std::move(tasks.front());
+                tasks.pop();
+            }
+            task();
+        }
+    }
+};
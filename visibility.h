@@ -0,0 +1,209 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include <glm/glm.hpp>
+#include "cube.h"
+#include "intersect.h"
+#include "raygen.h"
+#include "threadpool.h"
+
+const int VISIBILITY_BIN_SIZE = 32;
+
+// Per-pixel result of rasterising the scene's cubes: which object is visible,
+// how far along the pixel's primary ray, which face and where on it. Primary
+// shading can start from here instead of tracing the camera ray through the
+// whole scene.
+//
+// Faces are binned by their projected bounds and each screen bin is filled by
+// one pool task, so bins never write to the same pixels. Coverage and depth are
+// found per pixel by intersecting the pixel's ray with the face plane, which
+// keeps the buffer consistent with what castRay would have hit.
+class VisibilityBuffer {
+public:
+    VisibilityBuffer(int width, int height)
+            : width(width), height(height),
+              binsX((width + VISIBILITY_BIN_SIZE - 1) / VISIBILITY_BIN_SIZE),
+              binsY((height + VISIBILITY_BIN_SIZE - 1) / VISIBILITY_BIN_SIZE),
+              depth(static_cast<size_t>(width) * height),
+              objectId(static_cast<size_t>(width) * height),
+              faceCode(static_cast<size_t>(width) * height),
+              textureCoords(static_cast<size_t>(width) * height),
+              bins(static_cast<size_t>(binsX) * binsY) {}
+
+    // Rasterise the faces of the given cubes that point towards the camera.
+    // ids[i] is the value stored for pixels showing cubes[i].
+    void build(const CameraBasis& basis, const std::vector<const Cube*>& cubes, const std::vector<int>& ids,
+               ThreadPool& pool) {
+        faces.clear();
+        for (auto& bin : bins) {
+            bin.clear();
+        }
+
+        for (size_t i = 0; i < cubes.size(); i++) {
+            addFaces(basis, *cubes[i], ids[i]);
+        }
+
+        for (int f = 0; f < static_cast<int>(faces.size()); f++) {
+            const Face& face = faces[f];
+            for (int by = face.y0 / VISIBILITY_BIN_SIZE; by <= face.y1 / VISIBILITY_BIN_SIZE; by++) {
+                for (int bx = face.x0 / VISIBILITY_BIN_SIZE; bx <= face.x1 / VISIBILITY_BIN_SIZE; bx++) {
+                    bins[by * binsX + bx].push_back(f);
+                }
+            }
+        }
+
+        pool.parallelFor(binsX * binsY, [&](int bin) {
+            rasteriseBin(basis, bin);
+        });
+    }
+
+    // Rebuild the hit at (x, y) for a ray with the given origin and direction.
+    // Returns false when no cube covers the pixel.
+    bool fetch(int x, int y, const glm::vec3& rayOrigin, const glm::vec3& rayDirection,
+               Intersect& intersect, int& id) const {
+        size_t i = static_cast<size_t>(y) * width + x;
+        if (objectId[i] < 0) {
+            return false;
+        }
+        glm::vec3 normal(0.0f);
+        normal[faceCode[i] >> 1] = (faceCode[i] & 1) ? 1.0f : -1.0f;
+
+        id = objectId[i];
+        intersect = Intersect{true, depth[i], rayOrigin + depth[i] * rayDirection, normal, textureCoords[i]};
+        return true;
+    }
+
+private:
+    struct Face {
+        int id;
+        int axis;
+        float sign;
+        float plane;
+        glm::vec3 minBounds;
+        float sideLength;
+        int x0, y0, x1, y1;
+    };
+
+    int width;
+    int height;
+    int binsX;
+    int binsY;
+
+    std::vector<float> depth;
+    std::vector<int> objectId;
+    // Face axis * 2, plus 1 when the normal points along the positive axis
+    std::vector<std::uint8_t> faceCode;
+    std::vector<glm::vec2> textureCoords;
+
+    std::vector<Face> faces;
+    std::vector<std::vector<int>> bins;
+
+    void addFaces(const CameraBasis& basis, const Cube& cube, int id) {
+        float half = cube.getSideLength() * 0.5f;
+        glm::vec3 minBounds = cube.getCenter() - half;
+        glm::vec3 maxBounds = cube.getCenter() + half;
+
+        for (int axis = 0; axis < 3; axis++) {
+            // Only the face on the camera's side of each slab can be seen
+            float sign;
+            if (basis.origin[axis] > maxBounds[axis]) {
+                sign = 1.0f;
+            } else if (basis.origin[axis] < minBounds[axis]) {
+                sign = -1.0f;
+            } else {
+                continue;
+            }
+
+            Face face{id, axis, sign, sign > 0 ? maxBounds[axis] : minBounds[axis], minBounds, cube.getSideLength(),
+                      0, 0, width - 1, height - 1};
+            if (!projectBounds(basis, face, minBounds, maxBounds)) {
+                continue;
+            }
+            faces.push_back(face);
+        }
+    }
+
+    // Clamp the face's pixel bounds to its projected corners. Faces reaching
+    // behind the camera keep the whole screen. Returns false if off screen.
+    bool projectBounds(const CameraBasis& basis, Face& face, const glm::vec3& minBounds, const glm::vec3& maxBounds) const {
+        int u = (face.axis + 1) % 3;
+        int v = (face.axis + 2) % 3;
+        glm::vec2 lo(std::numeric_limits<float>::infinity());
+        glm::vec2 hi(-std::numeric_limits<float>::infinity());
+
+        for (int corner = 0; corner < 4; corner++) {
+            glm::vec3 p;
+            p[face.axis] = face.plane;
+            p[u] = (corner & 1) ? maxBounds[u] : minBounds[u];
+            p[v] = (corner & 2) ? maxBounds[v] : minBounds[v];
+
+            glm::vec2 pixel;
+            if (!basis.project(p, pixel)) {
+                return true;
+            }
+            lo = glm::vec2(std::min(lo.x, pixel.x), std::min(lo.y, pixel.y));
+            hi = glm::vec2(std::max(hi.x, pixel.x), std::max(hi.y, pixel.y));
+        }
+
+        // Pixel centres sit on integer coordinates; pad a pixel for rounding
+        face.x0 = std::max(0, static_cast<int>(std::floor(lo.x)));
+        face.y0 = std::max(0, static_cast<int>(std::floor(lo.y)));
+        face.x1 = std::min(width - 1, static_cast<int>(std::ceil(hi.x)));
+        face.y1 = std::min(height - 1, static_cast<int>(std::ceil(hi.y)));
+        return face.x0 <= face.x1 && face.y0 <= face.y1;
+    }
+
+    void rasteriseBin(const CameraBasis& basis, int bin) {
+        int bx0 = (bin % binsX) * VISIBILITY_BIN_SIZE;
+        int by0 = (bin / binsX) * VISIBILITY_BIN_SIZE;
+        int bx1 = std::min(bx0 + VISIBILITY_BIN_SIZE, width) - 1;
+        int by1 = std::min(by0 + VISIBILITY_BIN_SIZE, height) - 1;
+
+        for (int y = by0; y <= by1; y++) {
+            for (int x = bx0; x <= bx1; x++) {
+                size_t i = static_cast<size_t>(y) * width + x;
+                depth[i] = std::numeric_limits<float>::infinity();
+                objectId[i] = -1;
+            }
+        }
+
+        for (int f : bins[bin]) {
+            const Face& face = faces[f];
+            int u = (face.axis + 1) % 3;
+            int v = (face.axis + 2) % 3;
+            int x0 = std::max(face.x0, bx0), x1 = std::min(face.x1, bx1);
+            int y0 = std::max(face.y0, by0), y1 = std::min(face.y1, by1);
+
+            for (int y = y0; y <= y1; y++) {
+                for (int x = x0; x <= x1; x++) {
+                    glm::vec3 dir = basis.direction(x, y);
+                    if (dir[face.axis] * face.sign >= 0.0f) {
+                        continue;
+                    }
+                    float t = (face.plane - basis.origin[face.axis]) / dir[face.axis];
+                    size_t i = static_cast<size_t>(y) * width + x;
+                    if (t <= 0.0f || t >= depth[i]) {
+                        continue;
+                    }
+
+                    glm::vec3 hitVector = basis.origin + t * dir - face.minBounds;
+                    if (hitVector[u] < 0.0f || hitVector[u] > face.sideLength ||
+                        hitVector[v] < 0.0f || hitVector[v] > face.sideLength) {
+                        continue;
+                    }
+
+                    glm::vec3 normal(0.0f);
+                    normal[face.axis] = face.sign;
+                    depth[i] = t;
+                    objectId[i] = face.id;
+                    faceCode[i] = static_cast<std::uint8_t>(face.axis * 2 + (face.sign > 0 ? 1 : 0));
+                    textureCoords[i] = Cube::faceTexCoords(hitVector, normal, face.sideLength);
+                }
+            }
+        }
+    }
+};